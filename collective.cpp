@@ -66,6 +66,7 @@
 #include "dancing.h"
 #include "assembled_minion.h"
 #include "creature_experience_info.h"
+#include "sim_timer.h"
 
 template <class Archive>
 void Collective::serialize(Archive& ar, const unsigned int version) {
@@ -615,6 +616,7 @@ void Collective::updateMinionPromotions() {
 
 void Collective::tick() {
   PROFILE_BLOCK("Collective::tick");
+  SIM_TIMER(SimTimerId::COLLECTIVE_TICK);
   updateBorderTiles();
   considerRebellion();
   updateGuardTasks();
@@ -0,0 +1,157 @@
+#include "stdafx.h"
+#include "compressed_stream.h"
+#include "gzstream.h"
+#include <zlib.h>
+
+static const string chunkedMagic = "KRLCHNK1";
+static const int chunkSize = 4 * 1024 * 1024;
+
+static void writeUint32(std::ostream& out, uint32_t value) {
+  unsigned char bytes[4];
+  for (int i : Range(4))
+    bytes[i] = (value >> (8 * i)) & 0xff;
+  out.write((const char*) bytes, 4);
+}
+
+static optional<uint32_t> readUint32(std::istream& in) {
+  unsigned char bytes[4];
+  if (!in.read((char*) bytes, 4))
+    return none;
+  uint32_t ret = 0;
+  for (int i : Range(4))
+    ret |= uint32_t(bytes[i]) << (8 * i);
+  return ret;
+}
+
+ChunkedOutputBuf::ChunkedOutputBuf() {
+  chunks.emplace_back(chunkSize, 0);
+  setp(&chunks.back()[0], &chunks.back()[0] + chunkSize);
+}
+
+int ChunkedOutputBuf::overflow(int c) {
+  if (c != EOF) {
+    chunks.emplace_back(chunkSize, 0);
+    setp(&chunks.back()[0], &chunks.back()[0] + chunkSize);
+    *pptr() = char(c);
+    pbump(1);
+  }
+  return c;
+}
+
+size_t ChunkedOutputBuf::getSize() const {
+  return (chunks.size() - 1) * size_t(chunkSize) + (pptr() - pbase());
+}
+
+bool ChunkedOutputBuf::writeCompressed(const char* path) {
+  chunks.back().resize(pptr() - pbase());
+  vector<string> compressed(chunks.size());
+  runParallel(chunks.size(), [&](int index) {
+    auto& chunk = chunks[index];
+    auto size = compressBound(chunk.size());
+    compressed[index].resize(size);
+    CHECK(compress2((Bytef*) &compressed[index][0], &size, (const Bytef*) chunk.data(), chunk.size(),
+        Z_DEFAULT_COMPRESSION) == Z_OK);
+    compressed[index].resize(size);
+  });
+  std::ofstream out(path, std::ios::binary);
+  out.write(chunkedMagic.data(), chunkedMagic.size());
+  writeUint32(out, chunks.size());
+  for (int i : All(chunks)) {
+    writeUint32(out, chunks[i].size());
+    writeUint32(out, compressed[i].size());
+  }
+  for (auto& chunk : compressed)
+    out.write(chunk.data(), chunk.size());
+  chunks.back().resize(chunkSize);
+  out.close();
+  if (!out) {
+    remove(path);
+    return false;
+  }
+  return true;
+}
+
+ChunkedOutputStream::ChunkedOutputStream() : std::ostream(nullptr) {
+  rdbuf(&buf);
+}
+
+ChunkedOutputStream::ChunkedOutputStream(const char* p) : ChunkedOutputStream() {
+  path = string(p);
+}
+
+ChunkedOutputStream::~ChunkedOutputStream() {
+  if (path)
+    writeFile(path->data());
+}
+
+size_t ChunkedOutputStream::getSize() const {
+  return buf.getSize();
+}
+
+bool ChunkedOutputStream::writeFile(const char* path) {
+  return buf.writeCompressed(path);
+}
+
+ChunkedInputBuf::ChunkedInputBuf(std::ifstream f) : file(std::move(f)) {
+  if (auto numChunks = readUint32(file))
+    for (int i : Range(*numChunks)) {
+      auto rawSize = readUint32(file);
+      auto compressedSize = readUint32(file);
+      if (!rawSize || !compressedSize) {
+        chunkInfo.clear();
+        break;
+      }
+      chunkInfo.push_back(ChunkInfo{*rawSize, *compressedSize});
+    }
+  chunks.resize(chunkInfo.size());
+}
+
+static bool decompress(const string& input, string& output, uint32_t rawSize) {
+  output.resize(rawSize);
+  uLongf size = rawSize;
+  return uncompress((Bytef*) &output[0], &size, (const Bytef*) input.data(), input.size()) == Z_OK && size == rawSize;
+}
+
+int ChunkedInputBuf::underflow() {
+  while (gptr() == egptr()) {
+    if (current + 1 >= chunks.size())
+      return EOF;
+    if (current >= 0)
+      string().swap(chunks[current]);
+    ++current;
+    // The first chunk is decompressed on its own, it's enough to read the save header. Once the data
+    // goes past it, all remaining chunks are read and decompressed in parallel.
+    int end = current == 0 ? 1 : chunks.size();
+    if (current == 0 || current == 1) {
+      vector<string> compressed(end - current);
+      for (int i : Range(current, end)) {
+        compressed[i - current].resize(chunkInfo[i].compressedSize);
+        if (!file.read(&compressed[i - current][0], chunkInfo[i].compressedSize))
+          return EOF;
+      }
+      std::atomic<bool> failed(false);
+      runParallel(end - current, [&](int index) {
+        if (!decompress(compressed[index], chunks[current + index], chunkInfo[current + index].rawSize))
+          failed = true;
+      });
+      if (failed)
+        return EOF;
+    }
+    auto& chunk = chunks[current];
+    setg(&chunk[0], &chunk[0], &chunk[0] + chunk.size());
+  }
+  return traits_type::to_int_type(*gptr());
+}
+
+CompressedInputStream::CompressedInputStream(const char* path) : std::istream(nullptr) {
+  std::ifstream file(path, std::ios::binary);
+  string magic(chunkedMagic.size(), 0);
+  if (file.read(&magic[0], magic.size()) && magic == chunkedMagic)
+    buf = make_unique<ChunkedInputBuf>(std::move(file));
+  else {
+    auto gzBuf = make_unique<gzstreambuf>();
+    gzBuf->open(path, std::ios::in);
+    buf = std::move(gzBuf);
+  }
+  rdbuf(buf.get());
+}
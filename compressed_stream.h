@@ -0,0 +1,64 @@
+#pragma once
+
+#include "util.h"
+
+// Save container made of independently deflated chunks, so that compression and decompression
+// can be split between several threads. The layout is a magic string, the number of chunks, the raw
+// and compressed size of every chunk, and the compressed chunks.
+
+class ChunkedOutputBuf : public std::streambuf {
+  public:
+  ChunkedOutputBuf();
+  size_t getSize() const;
+  // Returns false and removes the file if it couldn't be written.
+  bool writeCompressed(const char* path);
+
+  protected:
+  virtual int overflow(int c) override;
+
+  private:
+  vector<string> chunks;
+};
+
+// Keeps everything written to it in memory until writeFile() is called, or until it's destroyed
+// if it was given a path. A file that couldn't be written completely is removed.
+class ChunkedOutputStream : public std::ostream {
+  public:
+  ChunkedOutputStream();
+  ChunkedOutputStream(const char* path);
+  ~ChunkedOutputStream();
+  size_t getSize() const;
+  bool writeFile(const char* path);
+
+  private:
+  ChunkedOutputBuf buf;
+  optional<string> path;
+};
+
+class ChunkedInputBuf : public std::streambuf {
+  public:
+  // The file must be positioned right after the magic string.
+  ChunkedInputBuf(std::ifstream);
+
+  protected:
+  virtual int underflow() override;
+
+  private:
+  struct ChunkInfo {
+    uint32_t rawSize;
+    uint32_t compressedSize;
+  };
+  std::ifstream file;
+  vector<ChunkInfo> chunkInfo;
+  vector<string> chunks;
+  int current = -1;
+};
+
+// Reads both the chunked format and plain gzip files written by older versions.
+class CompressedInputStream : public std::istream {
+  public:
+  CompressedInputStream(const char* path);
+
+  private:
+  unique_ptr<std::streambuf> buf;
+};
@@ -36,34 +36,80 @@ void setInitializedStatics() {
 }
 
 
-template<typename T>
-vector<string>& ContentId<T>::getAllIds() {
-  static vector<string> ret;
-  assert(staticsInitialized && !strcmp(staticsInitialized, "initialized"));
-  return ret;
+static std::atomic<int> numConcurrentScopes(0);
+
+ConcurrentContentIds::ConcurrentContentIds() {
+  ++numConcurrentScopes;
+}
+
+ConcurrentContentIds::~ConcurrentContentIds() {
+  --numConcurrentScopes;
 }
 
+namespace {
 template <typename T>
-static unordered_map<string, int>& getIdMap() {
-  static unordered_map<string, int> ids;
-  return ids;
+struct IdTables {
+  // Only changed while ids are created on a single thread, so it can always be read without locking.
+  unordered_map<string, int> ids;
+  // Ids created while a ConcurrentContentIds was alive.
+  unordered_map<string, int> concurrentIds;
+  std::mutex concurrentMutex;
+  // Names are stored in blocks that never move, so that they can be read while other threads add ids.
+  static constexpr int blockSize = 256;
+  unique_ptr<string[]> nameBlocks[(1 << (8 * sizeof(typename ContentId<T>::InternalId))) / blockSize];
+  int numIds = 0;
+
+  int add(const char* text, unordered_map<string, int>& table) {
+    CHECK(numIds < std::numeric_limits<typename ContentId<T>::InternalId>::max()) << "Too many content ids";
+    auto& block = nameBlocks[numIds / blockSize];
+    if (!block)
+      block.reset(new string[blockSize]);
+    block[numIds % blockSize] = text;
+    table[text] = numIds;
+    return numIds++;
+  }
+};
+}
+
+template <typename T>
+static IdTables<T>& getIdTables() {
+  static IdTables<T> ret;
+  assert(staticsInitialized && !strcmp(staticsInitialized, "initialized"));
+  return ret;
 }
 
 template <typename T>
 bool ContentId<T>::existsId(const char* text) {
-  auto& ids = getIdMap<T>();
-  return ids.count(text);
+  auto& tables = getIdTables<T>();
+  if (tables.ids.count(text))
+    return true;
+  if (numConcurrentScopes > 0) {
+    std::lock_guard<std::mutex> lock(tables.concurrentMutex);
+    return tables.concurrentIds.count(text);
+  }
+  return tables.concurrentIds.count(text);
 }
 
 template <typename T>
 int ContentId<T>::getId(const char* text) {
-  auto& ids = getIdMap<T>();
-  static int generatedId = 0;
-  if (auto ret = getReferenceMaybe(ids, text))
+  auto& tables = getIdTables<T>();
+  if (auto ret = getReferenceMaybe(tables.ids, text))
+    return *ret;
+  if (numConcurrentScopes > 0) {
+    std::lock_guard<std::mutex> lock(tables.concurrentMutex);
+    if (auto ret = getReferenceMaybe(tables.concurrentIds, text))
+      return *ret;
+    return tables.add(text, tables.concurrentIds);
+  }
+  if (auto ret = getReferenceMaybe(tables.concurrentIds, text))
     return *ret;
-  ids[text] = generatedId;
-  getAllIds().push_back(text);
-  return generatedId++;
+  return tables.add(text, tables.ids);
+}
+
+template <typename T>
+const char* ContentId<T>::getName(InternalId id) {
+  auto& tables = getIdTables<T>();
+  return tables.nameBlocks[id / tables.blockSize][id % tables.blockSize].data();
 }
 
 template <typename T>
@@ -104,7 +150,7 @@ int ContentId<T>::getHash() const {
 
 template <typename T>
 const char* ContentId<T>::data() const {
-  return getAllIds()[id].data();
+  return getName(id);
 }
 
 template <typename T>
@@ -117,30 +163,100 @@ std::ostream& operator <<(std::ostream& d, ContentId<T> id) {
   return d << id.data();
 }
 
+static thread_local ContentIdTable* currentIdTable = nullptr;
+
+ContentIdTable::ContentIdTable(const void* archive) : archive(archive), previous(currentIdTable) {
+  currentIdTable = this;
+}
+
+ContentIdTable::~ContentIdTable() {
+  CHECK(currentIdTable == this);
+  currentIdTable = previous;
+}
+
+ContentIdTable* ContentIdTable::get(const void* archive) {
+  for (auto table = currentIdTable; !!table; table = table->previous)
+    if (table->archive == archive)
+      return table;
+  return nullptr;
+}
+
+int ContentIdTable::getNewTypeIndex() {
+  static std::atomic<int> numTypes(0);
+  return numTypes++;
+}
+
+ContentIdTable::TypeTable& ContentIdTable::getTypeTable(int typeIndex) {
+  while (types.size() <= typeIndex)
+    types.push_back(TypeTable{});
+  return types[typeIndex];
+}
+
 template <typename T>
-template <class Archive>
-void ContentId<T>::serialize(Archive& ar1, const unsigned int) {
-  if (Archive::is_loading::value) {
+static ContentIdTable::TypeTable* getIdTable(const void* archive) {
+  static const int typeIndex = ContentIdTable::getNewTypeIndex();
+  if (auto table = ContentIdTable::get(archive))
+    return &table->getTypeTable(typeIndex);
+  return nullptr;
+}
+
+template <typename Archive, typename InternalId, typename GetId>
+static void loadId(Archive& ar1, ContentIdTable::TypeTable* table, InternalId& id, GetId getId) {
+  if (!table) {
     string s;
     ar1(s);
     id = getId(s.data());
-  } else {
-    string s = data();
+    return;
+  }
+  int index;
+  ar1(index);
+  if (index == table->idByIndex.size()) {
+    string s;
+    ar1(s);
+    table->idByIndex.push_back(getId(s.data()));
+  }
+  if (index < 0 || index >= table->idByIndex.size())
+    throw cereal::Exception("Bad content id index " + toString(index));
+  id = table->idByIndex[index];
+}
+
+template <typename Archive, typename InternalId>
+static void saveId(Archive& ar1, ContentIdTable::TypeTable* table, InternalId id, const char* data) {
+  if (!table) {
+    string s = data;
     ar1(s);
+    return;
   }
+  while (table->indexById.size() <= id)
+    table->indexById.push_back(-1);
+  int& index = table->indexById[id];
+  if (index == -1) {
+    index = table->idByIndex.size();
+    table->idByIndex.push_back(id);
+    string s = data;
+    ar1(index, s);
+  } else
+    ar1(index);
+}
+
+template <typename T>
+template <class Archive>
+void ContentId<T>::serialize(Archive& ar1, const unsigned int) {
+  auto table = getIdTable<T>(&ar1);
+  if (Archive::is_loading::value)
+    loadId(ar1, table, id, [](const char* s) { return getId(s); });
+  else
+    saveId(ar1, table, id, data());
 }
 
 template <typename T>
 template <class Archive>
 void PrimaryId<T>::serialize(Archive& ar1, const unsigned int) {
-  if (Archive::is_loading::value) {
-    string s;
-    ar1(s);
-    id = ContentId<T>::getId(s.data());
-  } else {
-    string s = data();
-    ar1(s);
-  }
+  auto table = getIdTable<T>(&ar1);
+  if (Archive::is_loading::value)
+    loadId(ar1, table, id, [](const char* s) { return ContentId<T>::getId(s); });
+  else
+    saveId(ar1, table, id, data());
 }
 
 template<typename T>
@@ -169,7 +285,7 @@ int PrimaryId<T>::getHash() const {
 
 template<typename T>
 const char* PrimaryId<T>::data() const {
-  return ContentId<T>::getAllIds()[id].data();
+  return ContentId<T>::getName(id);
 }
 
 template<typename T>
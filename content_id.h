@@ -30,12 +30,43 @@ class ContentId {
   private:
   friend PrimaryId<T>;
   InternalId id;
-  static vector<string>& getAllIds();
   static int getId(const char* text);
+  static const char* getName(InternalId);
 };
 
 void setInitializedStatics();
 
+// While alive, ContentIds may be created on several threads at once. Existing ids are still looked up
+// without locking, only new ones are added under a mutex.
+class ConcurrentContentIds {
+  public:
+  ConcurrentContentIds();
+  ~ConcurrentContentIds();
+  ConcurrentContentIds(const ConcurrentContentIds&) = delete;
+};
+
+// While alive, ContentIds and PrimaryIds serialized through the given archive on the current thread are stored
+// as indices, with every id string written only once, where it first occurs.
+class ContentIdTable {
+  public:
+  ContentIdTable(const void* archive);
+  ContentIdTable(const ContentIdTable&) = delete;
+  ~ContentIdTable();
+  static ContentIdTable* get(const void* archive);
+
+  struct TypeTable {
+    vector<int> indexById;
+    vector<int> idByIndex;
+  };
+  TypeTable& getTypeTable(int typeIndex);
+  static int getNewTypeIndex();
+
+  private:
+  const void* archive;
+  ContentIdTable* previous;
+  vector<TypeTable> types;
+};
+
 template <typename T>
 class PrimaryId {
   public:
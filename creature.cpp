@@ -67,6 +67,7 @@
 #include "buff_info.h"
 #include "collective.h"
 #include "special_trait.h"
+#include "sim_timer.h"
 
 template <class Archive>
 void Creature::serialize(Archive& ar, const unsigned int version) {
@@ -209,6 +210,7 @@ pair<CreatureAttributes, SpellMap> Creature::setAttributes(CreatureAttributes at
   auto ret = make_pair(std::move(*attributes), std::move(*spellMap));
   ret.first.permanentBuffs = std::move(permanentBuffs);
   attributes = std::move(attr);
+  invalidateAttrCache();
   spellMap = std::move(spells);
   modViewObject() = attributes->createViewObject();
   modViewObject().setGenericId(getUniqueId().getGenericId());
@@ -585,6 +587,7 @@ void Creature::swapPosition(Vec2 direction, bool withExcuseMe) {
 
 void Creature::makeMove() {
   PROFILE;
+  SIM_TIMER(SimTimerId::CREATURE_MOVE);
   auto time = *getGlobalTime();
   vision->update(this, time);
   CHECK(!isDead());
@@ -1148,12 +1151,37 @@ int simulAttackPen(int attackers) {
   return max(0, (attackers - 1) * 2);
 }
 
+void Creature::invalidateAttrCache() {
+  attrCache.clear();
+}
+
+const Creature::CachedAttr& Creature::getCachedAttr(AttrType type) const {
+  auto generation = make_tuple(attributes->getAttrGeneration(), equipment->getEquippedGeneration(),
+      Item::getModifierGeneration());
+  if (generation != attrCacheGeneration) {
+    attrCache.clear();
+    attrCacheGeneration = generation;
+  }
+  int index = type.getInternalId();
+  while (attrCache.size() <= index)
+    attrCache.push_back(none);
+  auto& cached = attrCache[index];
+  if (!cached) {
+    int raw = attributes->getRawAttr(type);
+    bool addsCombatExp = attributes->getMaxExpLevel().count(type) || type == AttrType("DEFENSE") ||
+        (raw > 0 && !attributes->fixedAttr.count(type));
+    int equipmentBonus = 0;
+    for (auto& item : equipment->getAllEquipped())
+      if (item->getClass() != ItemClass::WEAPON || type != item->getWeaponInfo().meleeAttackAttr)
+        equipmentBonus += item->getModifier(type);
+    cached = CachedAttr{raw, addsCombatExp, equipmentBonus};
+  }
+  return *cached;
+}
+
 int Creature::getAttrBonus(AttrType type, int rawAttr, bool includeWeapon) const {
   PROFILE
-  int def = min(killTitles.size(), rawAttr);
-  for (auto& item : equipment->getAllEquipped())
-    if (item->getClass() != ItemClass::WEAPON || type != item->getWeaponInfo().meleeAttackAttr)
-      def += item->getModifier(type);
+  int def = min(killTitles.size(), rawAttr) + getCachedAttr(type).equipment;
   if (includeWeapon)
     if (auto item = getFirstWeapon())
       if (type == item->getWeaponInfo().meleeAttackAttr)
@@ -1197,12 +1225,8 @@ int Creature::getPoints() const {
 
 int Creature::getRawAttr(AttrType type, int combatExp) const {
   PROFILE;
-  int ret = attributes->getRawAttr(type);
-  if (attributes->getMaxExpLevel().count(type) || type == AttrType("DEFENSE") || (
-      ret > 0 && !attributes->fixedAttr.count(type))) {
-    ret += combatExp;
-  }
-  return ret;
+  auto& cached = getCachedAttr(type);
+  return cached.addsCombatExp ? cached.raw + combatExp : cached.raw;
 }
 
 double Creature::getCombatExperience(bool respectMaxPromotion, bool includeTeamExp) const {
@@ -123,6 +123,8 @@ class Creature : public Renderable, public UniqueEntity<Creature>, public OwnedO
   int getAttrWithExp(AttrType, int combatExperience, bool includeWeapon = true) const;
   int getSpecialAttr(AttrType, const Creature* against) const;
   int getAttrBonus(AttrType, int rawAttr, bool includeWeapon) const;
+  // Needed when modifiers of an already equipped item change.
+  void invalidateAttrCache();
 
   double getFlankedMod() const;
   int getPoints() const;
@@ -404,6 +406,16 @@ class Creature : public Renderable, public UniqueEntity<Creature>, public OwnedO
   vector<TString> SERIAL(killTitles);
   vector<KillInfo> SERIAL(kills);
   mutable int SERIAL(difficultyPoints) = 0;
+  struct CachedAttr {
+    int raw;
+    bool addsCombatExp;
+    // Modifiers of all equipped items, except the melee damage of weapons, which is added by getAttrBonus.
+    int equipment;
+  };
+  // Indexed by AttrType::getInternalId(), valid for the given attributes, equipment and item modifier generations.
+  mutable vector<optional<CachedAttr>> attrCache;
+  mutable tuple<int, int, int> attrCacheGeneration = make_tuple(-1, -1, -1);
+  const CachedAttr& getCachedAttr(AttrType) const;
   int SERIAL(points) = 0;
   using MoveId = pair<int, LevelId>;
   MoveId getCurrentMoveId() const;
@@ -467,6 +479,9 @@ class Creature : public Renderable, public UniqueEntity<Creature>, public OwnedO
     SERIALIZE_ALL(enemy, opponent, timeout)
   };
   optional<DuelInfo> SERIAL(duelInfo);
+  friend class TimeQueue;
+  // Index of this creature's scheduling state in the TimeQueue that owns it.
+  int timeQueueIndex = -1;
 };
 
 struct AdjectiveInfo {
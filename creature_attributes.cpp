@@ -111,18 +111,25 @@ const CreatureName& CreatureAttributes::getName() const {
 }
 
 void CreatureAttributes::increaseBaseAttr(AttrType type, int v) {
+  ++attrGeneration;
   attr[type] += v;
   attr[type] = max(0, attr[type]);
 }
 
 HashMap<AttrType, int>& CreatureAttributes::getAllAttr() {
+  ++attrGeneration;
   return attr;
 }
 
 void CreatureAttributes::setBaseAttr(AttrType type, int v) {
+  ++attrGeneration;
   attr[type] = max(0, v);
 }
 
+int CreatureAttributes::getAttrGeneration() const {
+  return attrGeneration;
+}
+
 void CreatureAttributes::setAIType(AIType type) {
   aiType = type;
 }
@@ -169,11 +176,13 @@ const HashMap<AttrType, int>& CreatureAttributes::getMaxExpLevel() const {
 }
 
 void CreatureAttributes::increaseMaxExpLevel(AttrType type, int increase) {
+  ++attrGeneration;
   maxLevelIncrease[type] = max(0, maxLevelIncrease[type] + increase);
   expLevel[type] = min<double>(expLevel[type], maxLevelIncrease[type]);
 }
 
 void CreatureAttributes::increaseExpLevel(AttrType type, double increase) {
+  ++attrGeneration;
   increase = max(0.0, min(increase, (double) maxLevelIncrease[type] - expLevel[type]));
   expLevel[type] += increase;
 }
@@ -328,6 +337,7 @@ void CreatureAttributes::consume(Creature* self, CreatureAttributes& other) {
   vector<TString> adjectives;
   body->consumeBodyParts(self, other.getBody(), adjectives);
   auto factory = self->getGame()->getContentFactory();
+  ++attrGeneration;
   for (auto& t: factory->attrInfo)
     consumeAttr(attr[t.first], other.attr[t.first], adjectives,
       TSentence("MORE_ADJECTIVE", t.second.adjective), t.second.absorptionCap);
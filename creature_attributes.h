@@ -74,6 +74,8 @@ class CreatureAttributes {
   HashMap<AttrType, int>& getAllAttr();
   void increaseBaseAttr(AttrType, int);
   void setBaseAttr(AttrType, int);
+  // Changes whenever anything getRawAttr() depends on is modified.
+  int getAttrGeneration() const;
   void setAIType(AIType);
   AIType getAIType() const;
   const TString& getDeathDescription(const ContentFactory*) const;
@@ -171,6 +173,7 @@ class CreatureAttributes {
   MinionActivityMap SERIAL(minionActivities);
   HashMap<AttrType, double> SERIAL(expLevel);
   HashMap<AttrType, int> SERIAL(maxLevelIncrease);
+  int attrGeneration = 0;
   bool SERIAL(noAttackSound) = false;
   optional<CreatureId> SERIAL(creatureId);
   optional<TString> SERIAL(deathDescription);
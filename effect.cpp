@@ -139,6 +139,7 @@ static bool enhanceArmor(Creature* c, int mod, TStringId verb1, TStringId verb2)
         c->verb(verb1, verb2, item->getName());
         if (item->getModifier(AttrType("DEFENSE")) > 0 || mod > 0)
           item->addModifier(AttrType("DEFENSE"), mod);
+        c->invalidateAttrCache();
         return true;
       }
   return false;
@@ -156,6 +157,7 @@ static bool enhanceWeapon(Creature* c, int mod, TStringId verb1, TStringId verb2
       return item->getWeaponInfo().meleeAttackAttr;
     }();
     item->addModifier(attr, mod);
+    c->invalidateAttrCache();
     return true;
   }
   return false;
@@ -60,6 +60,10 @@ const vector<Item*>& Equipment::getAllEquipped() const {
   return equipped;
 }
 
+int Equipment::getEquippedGeneration() const {
+  return equippedGeneration;
+}
+
 const vector<Item*>& Equipment::getItems() const {
   return inventory.getItems();
 }
@@ -106,6 +110,7 @@ bool Equipment::canEquip(const Item* item, const Creature* c) const {
 void Equipment::equip(Item* item, EquipmentSlot slot, Creature* c, const ContentFactory* factory) {
   items[slot].push_back(item);
   equipped.push_back(item);
+  ++equippedGeneration;
   item->onEquip(c, true, factory);
   CHECK(inventory.hasItem(item));
 }
@@ -113,6 +118,7 @@ void Equipment::equip(Item* item, EquipmentSlot slot, Creature* c, const Content
 void Equipment::unequip(Item* item, Creature* c, const ContentFactory* factory) {
   items[item->getEquipmentSlot()].removeElement(item);
   equipped.removeElement(item);
+  ++equippedGeneration;
   item->onUnequip(c, true, factory);
 }
 
@@ -35,6 +35,8 @@ class Equipment {
   PItem removeItem(Item*, Creature*);
   int getMaxItems(EquipmentSlot, const Creature*) const;
   const vector<Item*>& getAllEquipped() const;
+  // Changes whenever an item is equipped or unequipped.
+  int getEquippedGeneration() const;
   const vector<Item*>& getItems() const;
   const vector<Item*>& getItems(ItemIndex) const;
   Item* getItemById(UniqueEntity<Item>::Id) const;
@@ -54,6 +56,7 @@ class Equipment {
   Inventory SERIAL(inventory);
   EnumMap<EquipmentSlot, vector<Item*>> SERIAL(items);
   vector<Item*> SERIAL(equipped);
+  int equippedGeneration = 0;
   void onRemoved(Item*, Creature*, const ContentFactory*);
 };
 
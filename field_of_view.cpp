@@ -24,8 +24,10 @@
 template <class Archive>
 void FieldOfView::serialize(Archive& ar, const unsigned int) {
   ar(level, vision, blocking);
-  if (Archive::is_loading::value)
+  if (Archive::is_loading::value) {
+    removeLruEntries();
     visibility = Table<unique_ptr<Visibility>>(level->getBounds());
+  }
 }
 
 #ifdef MEM_USAGE_TEST
@@ -55,35 +57,216 @@ FieldOfView::FieldOfView(Level* l, VisionId v, const ContentFactory* factory)
     blocking[v] = !Position(v, level).canSeeThru(vision, factory);
 }
 
+FieldOfView::FieldOfView(FieldOfView&& o) noexcept : level(o.level), visibility(std::move(o.visibility)),
+    vision(o.vision), blocking(std::move(o.blocking)), lruOwner(std::move(o.lruOwner)), lruListId(o.lruListId),
+    memoryUsage(o.memoryUsage) {
+  o.memoryUsage = 0;
+  setLruOwner(this);
+}
+
+FieldOfView& FieldOfView::operator = (FieldOfView&& o) noexcept {
+  removeLruEntries();
+  level = o.level;
+  visibility = std::move(o.visibility);
+  vision = o.vision;
+  blocking = std::move(o.blocking);
+  lruOwner = std::move(o.lruOwner);
+  lruListId = o.lruListId;
+  memoryUsage = o.memoryUsage;
+  o.memoryUsage = 0;
+  setLruOwner(this);
+  return *this;
+}
+
+FieldOfView::~FieldOfView() {
+  removeLruEntries();
+}
+
+static std::atomic<long long> fovMemoryLimit(256 * 1024 * 1024);
+static std::atomic<long long> fovMemoryUsage(0);
+static std::atomic<long long> fovCacheHits(0);
+static std::atomic<long long> fovCacheMisses(0);
+static std::atomic<long long> fovCacheEvictions(0);
+
+void FieldOfView::setMemoryLimit(long long bytes) {
+  fovMemoryLimit = bytes;
+}
+
+FieldOfView::CacheStats FieldOfView::getCacheStats() {
+  return CacheStats{fovCacheHits, fovCacheMisses, fovCacheEvictions, fovMemoryUsage};
+}
+
+void FieldOfView::addMemoryUsage(long long bytes) {
+  memoryUsage += bytes;
+  fovMemoryUsage += bytes;
+}
+
+struct FieldOfView::LruOwner {
+  // Locked while the visibilities are evicted through an entry, which can happen on another thread.
+  std::mutex mutex;
+  FieldOfView* fov;
+};
+
+struct FieldOfView::ThreadLru {
+  LruList list;
+  // Unlike the address of the list, it's never reused by another thread.
+  long long id;
+};
+
+FieldOfView::ThreadLru& FieldOfView::getThreadLru() {
+  static std::atomic<long long> numLists(0);
+  static thread_local ThreadLru ret{LruList(), ++numLists};
+  return ret;
+}
+
+// A field of view that moved to another thread, like a model that was generated on a worker, leaves its entries
+// in the old list and adds new ones to the current thread's list.
+FieldOfView::LruList& FieldOfView::getLruList() {
+  auto& lru = getThreadLru();
+  if (lruListId != lru.id) {
+    if (lruOwner) {
+      std::lock_guard<std::mutex> lock(lruOwner->mutex);
+      lruOwner->fov = nullptr;
+    }
+    lruOwner = make_shared<LruOwner>();
+    lruOwner->fov = this;
+    lruListId = lru.id;
+    if (memoryUsage > 0)
+      for (Vec2 v : visibility.getBounds())
+        if (auto& elem = visibility[v]) {
+          lru.list.push_front(LruEntry{lruOwner, v});
+          elem->lruPosition = lru.list.begin();
+        }
+  }
+  return lru.list;
+}
+
+void FieldOfView::removeLruEntries() {
+  if (lruOwner) {
+    {
+      std::lock_guard<std::mutex> lock(lruOwner->mutex);
+      lruOwner->fov = nullptr;
+    }
+    auto& lru = getThreadLru();
+    if (lruListId == lru.id && memoryUsage > 0)
+      for (Vec2 v : visibility.getBounds())
+        if (auto& elem = visibility[v])
+          lru.list.erase(elem->lruPosition);
+    lruOwner.reset();
+    lruListId = 0;
+  }
+  addMemoryUsage(-memoryUsage);
+}
+
+void FieldOfView::setLruOwner(FieldOfView* owner) {
+  if (lruOwner) {
+    std::lock_guard<std::mutex> lock(lruOwner->mutex);
+    lruOwner->fov = owner;
+  }
+}
+
+void FieldOfView::evictVisibilities(LruList& lruList) {
+  // Never evict the most recent entry, the caller is about to use it.
+  while (fovMemoryUsage > fovMemoryLimit && lruList.size() > 1) {
+    auto owner = std::move(lruList.back().owner);
+    auto pos = lruList.back().pos;
+    lruList.pop_back();
+    std::lock_guard<std::mutex> lock(owner->mutex);
+    if (auto fov = owner->fov) {
+      auto& elem = fov->visibility[pos];
+      fov->addMemoryUsage(-elem->getMemoryUsage());
+      elem.reset();
+      ++fovCacheEvictions;
+    }
+  }
+}
+
+FieldOfView::Visibility& FieldOfView::getVisibility(Vec2 from) {
+  auto& lruList = getLruList();
+  auto& ret = visibility[from];
+  if (!ret) {
+    ++fovCacheMisses;
+    ret.reset(new Visibility(level->getBounds(), blocking, from.x, from.y));
+    lruList.push_front(LruEntry{lruOwner, from});
+    ret->lruPosition = lruList.begin();
+    addMemoryUsage(ret->getMemoryUsage());
+    evictVisibilities(lruList);
+  } else {
+    ++fovCacheHits;
+    lruList.splice(lruList.begin(), lruList, ret->lruPosition);
+    if (ret->isDirty()) {
+      addMemoryUsage(-ret->getMemoryUsage());
+      ret->update(level->getBounds(), blocking);
+      addMemoryUsage(ret->getMemoryUsage());
+    }
+  }
+  return *ret;
+}
+
 bool FieldOfView::canSee(Vec2 from, Vec2 to) {
   PROFILE;;
   if ((from - to).lengthD() > sightRange)
     return false;
-  if (!visibility[from])
-    visibility[from].reset(new Visibility(level->getBounds(), blocking, from.x, from.y));
-  return visibility[from]->checkVisible(to.x - from.x, to.y - from.y);
+  return getVisibility(from).checkVisible(to.x - from.x, to.y - from.y);
 }
 
 void FieldOfView::squareChanged(Vec2 pos) {
   PROFILE;
+  // Takes over the visibilities from the thread that used them before, so that it can't evict them meanwhile.
+  getLruList();
   blocking[pos] = !Position(pos, level).canSeeThru(vision);
-  vector<Vec2> updateList;
-  if (!visibility[pos])
-    visibility[pos].reset(new Visibility(level->getBounds(), blocking, pos.x, pos.y));
   for (Vec2 v : Rectangle::centered(pos, sightRange))
-    if (v.inRectangle(visibility.getBounds()) && visibility[v] && visibility[v]->checkVisible(pos.x - v.x, pos.y - v.y)) {
-      visibility[v].reset();
-    }
+    if (v.inRectangle(visibility.getBounds()) && visibility[v] && visibility[v]->checkVisible(pos.x - v.x, pos.y - v.y))
+      visibility[v]->squareChanged(pos.x - v.x, pos.y - v.y);
+}
+
+static_assert(FieldOfView::sightRange % 2 == 0 && 2 * FieldOfView::sightRange + 4 == 64,
+    "Two rows of a cone must fill exactly one word");
+
+static Vec2 getConeVec(int cone, int p, int k) {
+  switch (cone) {
+    case 0: return Vec2(p, k);
+    case 1: return Vec2(k, -p);
+    case 2: return Vec2(-p, -k);
+    default: return Vec2(-k, p);
+  }
+}
+
+static pair<int, int> getConeCoord(int cone, Vec2 v) {
+  switch (cone) {
+    case 0: return {v.x, v.y};
+    case 1: return {-v.y, v.x};
+    case 2: return {-v.x, -v.y};
+    default: return {v.y, -v.x};
+  }
 }
 
-void FieldOfView::Visibility::setVisible(Rectangle bounds, int x, int y) {
-  if (Vec2(px + x, py + y).inRectangle(bounds) &&
-      !visible[x + sightRange][y + sightRange] && x * x + y * y <= sightRange * sightRange) {
-    visible[x + sightRange][y + sightRange] = 1;
-    visibleTiles.push_back(SVec2{short(px + x), short(py + y)});
+static bool isInCone(int p, int k) {
+  return k >= 1 && k <= FieldOfView::sightRange && abs(p) <= k;
+}
+
+// Returns the word and bit of tile p in row k of a cone.
+static pair<int, int> getConeBit(int p, int k) {
+  if (k <= FieldOfView::sightRange / 2)
+    return {k - 1, p + k};
+  int k2 = FieldOfView::sightRange + 1 - k;
+  return {k2 - 1, 2 * k2 + 1 + p + k};
+}
+
+void FieldOfView::Visibility::setVisible(Rectangle bounds, int cone, int p, int k) {
+  Vec2 v = getConeVec(cone, p, k);
+  if (isInCone(p, k) && Vec2(px + v.x, py + v.y).inRectangle(bounds) &&
+      v.x * v.x + v.y * v.y <= sightRange * sightRange) {
+    auto bit = getConeBit(p, k);
+    cones[cone][bit.first] |= uint64_t(1) << bit.second;
   }
 }
 
+bool FieldOfView::Visibility::isVisible(int cone, int p, int k) const {
+  auto bit = getConeBit(p, k);
+  return (cones[cone][bit.first] >> bit.second) & 1;
+}
+
 template <typename Fun1, typename Fun2>
 static void calculate(int left, int right, int up, int h, int x1, int y1, int x2, int y2, Fun1 isBlocking, Fun2 setVisible){
   if (y2*x1>=y1*x2) return;
@@ -125,24 +308,65 @@ static void calculate(int left, int right, int up, int h, int x1, int y1, int x2
 
 FieldOfView::Visibility::Visibility(Rectangle bounds, const Table<bool>& blocking, int x, int y) : px(x), py(y) {
   PROFILE;
-  calculate(2 * sightRange, 2 * sightRange,2 * sightRange, 2,-1,1,1,1,
-      [&](int px, int py) { return blocking[Vec2(x + px, y + py)]; },
-      [&](int px, int py) { setVisible(bounds, px, py); });
-  calculate(2 * sightRange, 2 * sightRange,2 * sightRange, 2,-1,1,1,1,
-      [&](int px, int py) { return blocking[Vec2(x + py, y - px)]; },
-      [&](int px, int py) { setVisible(bounds, py, -px); });
-  calculate(2 * sightRange, 2 * sightRange,2 * sightRange,2,-1,1,1,1,
-      [&](int px, int py) { return blocking[Vec2(x - px, y - py)]; },
-      [&](int px, int py) { setVisible(bounds, -px, -py); });
-  calculate(2 * sightRange, 2 * sightRange,2 * sightRange,2,-1,1,1,1,
-      [&](int px, int py) { return blocking[Vec2(x - py, y + px)]; },
-      [&](int px, int py) { setVisible(bounds, -py, px); });
-  setVisible(bounds, 0, 0);
+  for (int cone : Range(4))
+    calculateCone(bounds, blocking, cone);
+  updateVisibleTiles();
+}
+
+void FieldOfView::Visibility::calculateCone(Rectangle bounds, const Table<bool>& blocking, int cone) {
+  for (auto& word : cones[cone])
+    word = 0;
+  calculate(2 * sightRange, 2 * sightRange, 2 * sightRange, 2, -1, 1, 1, 1,
+      [&](int p, int k) { return blocking[Vec2(px, py) + getConeVec(cone, p, k)]; },
+      [&](int p, int k) { setVisible(bounds, cone, p, k); });
+}
+
+void FieldOfView::Visibility::updateVisibleTiles() {
+  visibleTiles.clear();
+  visibleTiles.push_back(SVec2{short(px), short(py)});
+  for (int cone : Range(4))
+    for (int word : Range(numWords))
+      for (uint64_t bits = cones[cone][word]; bits; bits &= bits - 1) {
+        int bit = __builtin_ctzll(bits);
+        int k = word + 1;
+        int p = bit - k;
+        if (bit > 2 * k) {
+          k = sightRange + 1 - k;
+          p = bit - 2 * (word + 1) - 1 - k;
+        }
+        // Diagonal tiles belong to two cones, list them only once.
+        if (p == k && isVisible((cone + 1) % 4, -k, k))
+          continue;
+        Vec2 v = getConeVec(cone, p, k);
+        visibleTiles.push_back(SVec2{short(px + v.x), short(py + v.y)});
+      }
   visibleTiles.shrink_to_fit();
-/*  ++numSamples;
-  totalIter += visibleTiles.size();
-  if (numSamples%100 == 0)
-    INFO << numSamples << " iterations " << totalIter / numSamples << " avg";*/
+}
+
+void FieldOfView::Visibility::squareChanged(int x, int y) {
+  for (int cone : Range(4)) {
+    auto coord = getConeCoord(cone, Vec2(x, y));
+    if (isInCone(coord.first, coord.second))
+      dirtyCones |= 1 << cone;
+  }
+}
+
+bool FieldOfView::Visibility::isDirty() const {
+  return dirtyCones != 0;
+}
+
+void FieldOfView::Visibility::update(Rectangle bounds, const Table<bool>& blocking) {
+  PROFILE;
+  for (int cone : Range(4))
+    if (dirtyCones & (1 << cone))
+      calculateCone(bounds, blocking, cone);
+  dirtyCones = 0;
+  updateVisibleTiles();
+}
+
+long long FieldOfView::Visibility::getMemoryUsage() const {
+  // Include the list node in the LRU list.
+  return sizeof(Visibility) + visibleTiles.capacity() * sizeof(SVec2) + 4 * sizeof(void*);
 }
 
 const vector<SVec2>& FieldOfView::Visibility::getVisibleTiles() const {
@@ -150,15 +374,75 @@ const vector<SVec2>& FieldOfView::Visibility::getVisibleTiles() const {
 }
 
 const vector<SVec2>& FieldOfView::getVisibleTiles(Vec2 from) {
-  if (!visibility[from]) {
-    visibility[from].reset(new Visibility(level->getBounds(), blocking, from.x, from.y));
-  }
-  return visibility[from]->getVisibleTiles();
+  return getVisibility(from).getVisibleTiles();
 }
 
 bool FieldOfView::Visibility::checkVisible(int x, int y) const {
-  return x >= -sightRange && y >= -sightRange && x <= sightRange && y <= sightRange &&
-    visible[sightRange + x][sightRange + y] == 1;
+  if (x == 0 && y == 0)
+    return true;
+  for (int cone : Range(4)) {
+    auto coord = getConeCoord(cone, Vec2(x, y));
+    if (isInCone(coord.first, coord.second) && isVisible(cone, coord.first, coord.second))
+      return true;
+  }
+  return false;
 }
 
-
+// Compares the cone packed visibility with a shadowcast into a dense table, the way it was computed
+// before the view was split into cones.
+void FieldOfView::runTests() {
+  Rectangle bounds(50, 50);
+  Table<bool> blocking(bounds.minusMargin(-1), true);
+  for (Vec2 v : bounds)
+    blocking[v] = Random.roll(5);
+  auto getExpected = [&] (Vec2 pos) {
+    Table<bool> ret(Rectangle::centered(sightRange), false);
+    ret[Vec2(0, 0)] = true;
+    auto setVisible = [&] (int x, int y) {
+      if ((pos + Vec2(x, y)).inRectangle(bounds) && x * x + y * y <= sightRange * sightRange)
+        ret[Vec2(x, y)] = true;
+    };
+    for (int cone : Range(4))
+      calculate(2 * sightRange, 2 * sightRange, 2 * sightRange, 2, -1, 1, 1, 1,
+          [&](int p, int k) { return blocking[pos + getConeVec(cone, p, k)]; },
+          [&](int p, int k) { auto v = getConeVec(cone, p, k); setVisible(v.x, v.y); });
+    return ret;
+  };
+  auto compare = [&] (const Visibility& vis, Vec2 pos) {
+    auto expected = getExpected(pos);
+    int numVisible = 0;
+    for (Vec2 v : expected.getBounds()) {
+      CHECK(vis.checkVisible(v.x, v.y) == expected[v]) << pos << " " << v;
+      if (expected[v])
+        ++numVisible;
+    }
+    HashSet<Vec2> tiles;
+    for (auto tile : vis.getVisibleTiles()) {
+      Vec2 v(tile.x - pos.x, tile.y - pos.y);
+      CHECK(v.inRectangle(expected.getBounds()) && expected[v] && !tiles.count(v)) << pos << " " << v;
+      tiles.insert(v);
+    }
+    CHECK(tiles.size() == numVisible);
+  };
+  auto toggle = [&] (Visibility& vis, Vec2 pos, Vec2 v) {
+    if (!v.inRectangle(bounds))
+      return;
+    blocking[v] = !blocking[v];
+    if (vis.checkVisible(v.x - pos.x, v.y - pos.y))
+      vis.squareChanged(v.x - pos.x, v.y - pos.y);
+    if (vis.isDirty())
+      vis.update(bounds, blocking);
+    compare(vis, pos);
+  };
+  for (int i : Range(30)) {
+    Vec2 pos = bounds.random(Random);
+    Visibility vis(bounds, blocking, pos.x, pos.y);
+    compare(vis, pos);
+    // Diagonal tiles are shared by two cones.
+    for (int k : Range(1, 8))
+      for (Vec2 dir : {Vec2(1, 1), Vec2(1, -1), Vec2(-1, -1), Vec2(-1, 1)})
+        toggle(vis, pos, pos + dir * k);
+    for (int j : Range(20))
+      toggle(vis, pos, pos + Rectangle::centered(sightRange).random(Random));
+  }
+}
@@ -15,6 +15,8 @@
 
 #pragma once
 
+#include <list>
+
 #include "util.h"
 
 class Square;
@@ -24,6 +26,9 @@ class ContentFactory;
 class FieldOfView {
   public:
   FieldOfView(Level*, VisionId, const ContentFactory*);
+  FieldOfView(FieldOfView&&) noexcept;
+  FieldOfView& operator = (FieldOfView&&) noexcept;
+  ~FieldOfView();
   bool canSee(Vec2 from, Vec2 to);
   const vector<SVec2>& getVisibleTiles(Vec2 from);
   void squareChanged(Vec2 pos);
@@ -32,8 +37,30 @@ class FieldOfView {
 
   static constexpr int sightRange = 30;
 
-  private:
+  // Cached visibilities of all fields of view share a memory limit, least recently used ones are evicted first.
+  static void setMemoryLimit(long long bytes);
+  struct CacheStats {
+    long long hits;
+    long long misses;
+    long long evictions;
+    long long memoryUsage;
+  };
+  static CacheStats getCacheStats();
 
+  static void runTests();
+
+  private:
+  // Entry of the least recently used list of visibilities. Every thread has its own list with the visibilities
+  // of all fields of view used on it, so that hits don't need a lock and eviction frees the coldest visibilities
+  // of all of them. A field of view that is used on another thread registers its visibilities in that thread's
+  // list, and its entries in the old one are dropped once they become the least recently used.
+  struct LruOwner;
+  struct LruEntry {
+    shared_ptr<LruOwner> owner;
+    Vec2 pos;
+  };
+  using LruList = std::list<LruEntry>;
+  struct ThreadLru;
 
   class Visibility {
     public:
@@ -43,20 +70,45 @@ class FieldOfView {
 
     Visibility(Rectangle bounds, const Table<bool>& blocking, int x, int y);
 
+    // Marks the parts of the view that a change of the given square can affect.
+    void squareChanged(int x, int y);
+    bool isDirty() const;
+    void update(Rectangle bounds, const Table<bool>& blocking);
+    long long getMemoryUsage() const;
+    LruList::iterator lruPosition;
+
     SERIALIZATION_DECL(Visibility)
 
     private:
-    array<bitset<sightRange * 2 + 1>, sightRange * 2 + 1> visible;
+    // The view is split into four cones along the axes, each computed separately by shadowcasting.
+    // Row k of a cone has 2k+1 tiles, so rows k and sightRange+1-k are packed together into one word.
+    static constexpr int numWords = sightRange / 2;
+    using Cone = array<uint64_t, numWords>;
+    array<Cone, 4> cones;
     vector<SVec2> SERIAL(visibleTiles);
-    void setVisible(Rectangle bounds, int, int);
+    void calculateCone(Rectangle bounds, const Table<bool>& blocking, int cone);
+    void setVisible(Rectangle bounds, int cone, int p, int k);
+    bool isVisible(int cone, int p, int k) const;
+    void updateVisibleTiles();
 
     int px;
     int py;
+    uint8_t dirtyCones = 0;
   };
+  Visibility& getVisibility(Vec2);
+  static void evictVisibilities(LruList&);
+  void addMemoryUsage(long long);
+  static ThreadLru& getThreadLru();
+  LruList& getLruList();
+  void removeLruEntries();
+  void setLruOwner(FieldOfView*);
 
   Level* SERIAL(level) = nullptr;
   Table<unique_ptr<Visibility>> visibility;
   VisionId SERIAL(vision);
   Table<bool> SERIAL(blocking);
+  shared_ptr<LruOwner> lruOwner;
+  long long lruListId = 0;
+  long long memoryUsage = 0;
 };
 
@@ -98,6 +98,24 @@ template <class T> T Curve<T>::sample(float position) const {
   return T();
 }
 
+template <class T> bool Curve<T>::isConstant() const {
+  for (int n = 1; n < num_keys; n++)
+    if (!(values[n] == values[0]))
+      return false;
+  return true;
+}
+
+static size_t valueHash(float value) { return combineHash(value); }
+static size_t valueHash(const FVec2 &value) { return combineHash(value.x, value.y); }
+static size_t valueHash(const FVec3 &value) { return combineHash(value.x, value.y, value.z); }
+
+template <class T> size_t Curve<T>::getHash() const {
+  size_t ret = combineHash(num_keys, interp);
+  for (int n = 0; n < num_keys; n++)
+    ret = combineHash(ret, keys[n], valueHash(values[n]));
+  return ret;
+}
+
 template <class T> void Curve<T>::print(int num_steps) const {
   /*if constexpr (std::is_same<T, float>()) {
     printf("Values: ");
@@ -20,6 +20,8 @@ template <class T> struct Curve {
 
   // Position is always within range: <0, 1>
   T sample(float position) const;
+  bool isConstant() const;
+  size_t getHash() const;
 
   void print(int num_steps = 20) const;
 
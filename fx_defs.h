@@ -77,6 +77,7 @@ struct EmitterDef {
 };
 
 using AnimateParticleFunc = void (*)(AnimationContext&, Particle&);
+using AnimateParticlesFunc = void (*)(AnimationContext&, vector<Particle>&);
 using DrawParticleFunc = bool (*)(DrawContext&, const Particle&, DrawParticle&);
 using DrawParticlesFunc = void (*)(DrawContext&, const Particle&, vector<DrawParticle>&, Color);
 
@@ -86,6 +87,7 @@ using PrepareEmissionFunc = float (*)(AnimationContext&, EmissionState&);
 using EmitParticleFunc = function<void(AnimationContext&, EmissionState&, Particle&)>;
 
 void defaultAnimateParticle(AnimationContext&, Particle&);
+void defaultAnimateParticles(AnimationContext&, vector<Particle>&);
 float defaultPrepareEmission(AnimationContext&, EmissionState&);
 void defaultEmitParticle(AnimationContext&, EmissionState&, Particle&);
 bool defaultDrawParticle(DrawContext&, const Particle&, DrawParticle&);
@@ -100,6 +102,8 @@ struct SubSystemDef {
   float emissionStart, emissionEnd;
 
   AnimateParticleFunc animateFunc = defaultAnimateParticle;
+  // Animates all particles of the subsystem at once; if not set, animateFunc is called for every particle
+  AnimateParticlesFunc animateAllFunc = nullptr;
   PrepareEmissionFunc prepareFunc = defaultPrepareEmission;
   EmitParticleFunc emitFunc = defaultEmitParticle;
   DrawParticleFunc drawFunc = defaultDrawParticle;
@@ -35,4 +35,8 @@ FVec2 EmissionSource::sample(RandomGen &rand) const {
 
   return {};
 }
+
+size_t EmissionSource::getHash() const {
+  return combineHash(pos.x, pos.y, param.x, param.y, type);
+}
 }
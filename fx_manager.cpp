@@ -5,6 +5,7 @@
 #include "fx_particle_system.h"
 #include "fx_rect.h"
 #include "clock.h"
+#include "version.h"
 
 namespace fx {
 
@@ -12,10 +13,17 @@ static FXManager *s_instance = nullptr;
 
 FXManager *FXManager::getInstance() { return s_instance; }
 
-FXManager::FXManager() {
+FXManager::FXManager(optional<FilePath> snapshotCache) : snapshotCachePath(std::move(snapshotCache)) {
+  auto startTime = Clock::getRealMicros().count();
   randomGen = make_unique<RandomGen>();
   initializeTextureDefs();
+  loadSnapshotCache();
   initializeDefs();
+  if (snapshotCacheChanged)
+    saveSnapshotCache();
+  for (auto name : ENUM_ALL(FXName))
+    cachedSnapshots[name] = none;
+  INFO << "FX: initialization took " << double(Clock::getRealMicros().count() - startTime) / 1000.0 << " msec";
   CHECK(s_instance == nullptr && "There can be only one!");
   s_instance = this;
 }
@@ -76,20 +84,20 @@ void FXManager::simulate(ParticleSystem &ps, float timeDelta) {
       auto &ssdef = psdef[ssid];
       AnimationContext ctx(ssctx(ps, ssid), globalSimTime, ps.animTime, timeDelta);
 
-      for (auto &pinst : ss.particles)
-        ssdef.animateFunc(ctx, pinst);
+      if (ssdef.animateAllFunc)
+        ssdef.animateAllFunc(ctx, ss.particles);
+      else
+        for (auto &pinst : ss.particles)
+          ssdef.animateFunc(ctx, pinst);
       ss.randomSeed = ctx.randomSeed();
     }
-  // Removing dead particles
-  for (auto &ssinst : ps.subSystems)
-    for (int n = 0; n < (int)ssinst.particles.size(); n++) {
-      auto &pinst = ssinst.particles[n];
-      if (pinst.life > pinst.maxLife) {
-        pinst = ssinst.particles.back();
-        ssinst.particles.pop_back();
-        n--;
-      }
-    }
+  // Removing dead particles in a single pass, keeping the order of the living ones
+  for (auto &ssinst : ps.subSystems) {
+    auto &particles = ssinst.particles;
+    particles.erase(std::remove_if(particles.begin(), particles.end(),
+                                   [](const Particle &pinst) { return pinst.life > pinst.maxLife; }),
+                    particles.end());
+  }
 
   // Emitting new particles
   for (int ssid = 0; ssid < (int)psdef.subSystems.size(); ssid++) {
@@ -198,6 +206,17 @@ void FXManager::genSnapshots(FXName name, vector<float> animTimes, vector<float>
   if (animTimes.empty())
     return;
 
+  auto hash = getSnapshotHash(name, animTimes, params, randomVariants);
+  snapshotHashes[name] = hash;
+  if (auto& cached = cachedSnapshots[name])
+    if (cached->hash == hash) {
+      snapshotGroups[name] = std::move(cached->groups);
+      cached = none;
+      INFO << "FX: loaded cached snapshots for: " << ENUM_STRING(name);
+      return;
+    }
+  snapshotCacheChanged = true;
+
   static constexpr float fps = 60.0f;
   std::sort(begin(animTimes), end(animTimes));
 
@@ -237,6 +256,148 @@ void FXManager::genSnapshots(FXName name, vector<float> animTimes, vector<float>
        << " (total frames: " << numFramesTotal << ")";
 }
 
+template <class T> static size_t curvesHash(const vector<Curve<T>> &curves) {
+  size_t ret = curves.size();
+  for (auto &curve : curves)
+    ret = combineHash(ret, curve.getHash());
+  return ret;
+}
+
+// Function pointers can't be hashed in a way that is stable between runs, so changes in animation code
+// are covered by the build version instead. That's only reliable in release builds, which are the only ones
+// that use the cache.
+static size_t defHash(const ParticleSystemDef &def) {
+  size_t ret = combineHash(def.animLength, def.randomOffset, def.isLooped, string(BUILD_DATE) + " " + BUILD_VERSION);
+  for (auto &ssdef : def.subSystems) {
+    auto &pdef = ssdef.particle;
+    auto &edef = ssdef.emitter;
+    ret = combineHash(ret, pdef.life.getHash(), pdef.alpha.getHash(), pdef.size.getHash(), pdef.slowdown.getHash(),
+                      pdef.color.getHash(), curvesHash(pdef.scalarCurves), curvesHash(pdef.colorCurves),
+                      pdef.textureName);
+    ret = combineHash(ret, edef.source.getHash(), edef.frequency.getHash(), edef.strength.getHash(),
+                      edef.strengthSpread.getHash(), edef.direction.getHash(), edef.directionSpread.getHash(),
+                      edef.rotSpeed.getHash(), edef.rotSpeedSpread.getHash(), curvesHash(edef.scalarCurves),
+                      curvesHash(edef.colorCurves), edef.initialSpawnCount);
+    ret = combineHash(ret, ssdef.emissionStart, ssdef.emissionEnd, ssdef.maxActiveParticles,
+                      ssdef.maxTotalParticles, ssdef.layer);
+  }
+  return ret;
+}
+
+size_t FXManager::getSnapshotHash(FXName name, const vector<float> &animTimes, const vector<float> &params,
+                                  int randomVariants) const {
+  size_t ret = combineHash(defHash(systemDefs[name]), randomVariants);
+  for (float time : animTimes)
+    ret = combineHash(ret, time);
+  for (float param : params)
+    ret = combineHash(ret, param);
+  return ret;
+}
+
+static const int snapshotCacheVersion = 1;
+static_assert(std::is_trivially_copyable<Particle>::value, "Particles are stored in the cache as raw bytes");
+
+template <class T> static void writeRaw(std::ostream &out, const T &value) {
+  out.write((const char *)&value, sizeof(T));
+}
+
+template <class T> static void readRaw(std::istream &in, T &value) {
+  if (!in.read((char *)&value, sizeof(T)))
+    throw std::runtime_error("Unexpected end of file");
+}
+
+void FXManager::loadSnapshotCache() {
+  if (!snapshotCachePath || !snapshotCachePath->exists())
+    return;
+  try {
+    std::ifstream in(snapshotCachePath->getPath(), std::ios::binary);
+    int version, numEffects;
+    readRaw(in, version);
+    if (version != snapshotCacheVersion)
+      return;
+    readRaw(in, numEffects);
+    for (int n = 0; n < numEffects; n++) {
+      int nameLength;
+      readRaw(in, nameLength);
+      string nameString(nameLength, 0);
+      if (!in.read(&nameString[0], nameLength))
+        throw std::runtime_error("Unexpected end of file");
+      CachedSnapshots cached;
+      int numGroups;
+      readRaw(in, cached.hash);
+      readRaw(in, numGroups);
+      cached.groups.resize(numGroups);
+      for (auto &group : cached.groups) {
+        int numSnapshots;
+        readRaw(in, group.key);
+        readRaw(in, numSnapshots);
+        group.snapshots.resize(numSnapshots);
+        for (auto &snapshot : group.snapshots) {
+          int numSubSystems;
+          readRaw(in, numSubSystems);
+          snapshot.resize(numSubSystems);
+          for (auto &ss : snapshot) {
+            int numParticles;
+            readRaw(in, ss.animationVars);
+            readRaw(in, ss.emissionFract);
+            readRaw(in, ss.randomSeed);
+            readRaw(in, ss.totalParticles);
+            readRaw(in, numParticles);
+            ss.particles.resize(numParticles);
+            if (!in.read((char *)ss.particles.data(), numParticles * sizeof(Particle)))
+              throw std::runtime_error("Unexpected end of file");
+          }
+        }
+      }
+      if (auto name = EnumInfo<FXName>::fromStringSafe(nameString))
+        cachedSnapshots[*name] = std::move(cached);
+    }
+  } catch (std::exception &e) {
+    INFO << "FX: failed to load snapshot cache: " << e.what();
+    for (auto name : ENUM_ALL(FXName))
+      cachedSnapshots[name] = none;
+  }
+}
+
+void FXManager::saveSnapshotCache() const {
+  if (!snapshotCachePath)
+    return;
+  auto tmpPath = snapshotCachePath->withSuffix(".tmp");
+  {
+    std::ofstream out(tmpPath.getPath(), std::ios::binary);
+    vector<FXName> names;
+    for (auto name : ENUM_ALL(FXName))
+      if (snapshotHashes[name])
+        names.push_back(name);
+    writeRaw(out, snapshotCacheVersion);
+    writeRaw(out, (int)names.size());
+    for (auto name : names) {
+      string nameString = ENUM_STRING(name);
+      writeRaw(out, (int)nameString.size());
+      out.write(nameString.data(), nameString.size());
+      writeRaw(out, *snapshotHashes[name]);
+      writeRaw(out, (int)snapshotGroups[name].size());
+      for (auto &group : snapshotGroups[name]) {
+        writeRaw(out, group.key);
+        writeRaw(out, (int)group.snapshots.size());
+        for (auto &snapshot : group.snapshots) {
+          writeRaw(out, (int)snapshot.size());
+          for (auto &ss : snapshot) {
+            writeRaw(out, ss.animationVars);
+            writeRaw(out, ss.emissionFract);
+            writeRaw(out, ss.randomSeed);
+            writeRaw(out, ss.totalParticles);
+            writeRaw(out, (int)ss.particles.size());
+            out.write((const char *)ss.particles.data(), ss.particles.size() * sizeof(Particle));
+          }
+        }
+      }
+    }
+  }
+  tmpPath.copyTo(*snapshotCachePath);
+  tmpPath.erase();
+}
+
 void FXManager::genQuads(vector<DrawParticle>& out, int id, int ssid) {
   PROFILE;
   auto& ps = systems[id];
@@ -342,6 +503,39 @@ ParticleSystemId FXManager::addSystem(FXName name, InitConfig config) {
 }
 
 void FXManager::addDef(FXName name, ParticleSystemDef def) {
+  for (auto &ssdef : def.subSystems)
+    if (!ssdef.animateAllFunc && ssdef.animateFunc == defaultAnimateParticle)
+      ssdef.animateAllFunc = defaultAnimateParticles;
   systemDefs[name] = std::move(def);
 }
+
+void FXManager::benchmark(int numInstances, int numFrames) {
+  const float timeDelta = 1.0f / 60.0f;
+  long long totalParticles = 0;
+  microseconds totalTime(0);
+  auto printResult = [](const string& name, long long particles, microseconds time) {
+    std::cout << name << ": " << particles << " particle updates in " << duration_cast<milliseconds>(time) << ", "
+              << particles / max<long long>(1, time.count()) << "M particles/s\n";
+  };
+  for (auto name : ENUM_ALL(FXName)) {
+    if (!systemDefs[name])
+      continue;
+    systems.clear();
+    for (int n = 0; n < numInstances; n++)
+      addSystem(name, InitConfig(FVec2(float(n % 32) * 24.0f, float(n / 32) * 24.0f), FVec2(48.0f, 0.0f)));
+    long long particles = 0;
+    auto begin = steady_clock::now();
+    for (int frame = 0; frame < numFrames; frame++) {
+      for (auto &ps : systems)
+        particles += ps.numActiveParticles();
+      simulate(timeDelta);
+    }
+    auto time = duration_cast<microseconds>(steady_clock::now() - begin);
+    printResult(ENUM_STRING(name), particles, time);
+    totalParticles += particles;
+    totalTime += time;
+  }
+  systems.clear();
+  printResult("Total", totalParticles, totalTime);
+}
 }
@@ -6,12 +6,14 @@
 #include "fx_defs.h"
 #include "fx_name.h"
 #include "fx_texture_name.h"
+#include "file_path.h"
 
 namespace fx {
 
 class FXManager {
 public:
-  FXManager();
+  // Generated snapshots are stored in snapshotCache and reused while the effect definitions don't change
+  FXManager(optional<FilePath> snapshotCache = none);
   ~FXManager();
 
   FXManager(const FXManager &) = delete;
@@ -64,6 +66,9 @@ public:
 
   void addDef(FXName, ParticleSystemDef);
 
+  // Simulates the given number of instances of every defined effect and prints the particle throughput
+  void benchmark(int numInstances, int numFrames);
+
   private:
   ParticleSystem makeSystem(FXName, uint spawnTime, InitConfig);
 
@@ -75,8 +80,20 @@ public:
   void simulate(ParticleSystem &, float timeDelta);
   SubSystemContext ssctx(ParticleSystem &, int);
 
+  size_t getSnapshotHash(FXName, const vector<float>& animTimes, const vector<float>& params, int randomVariants) const;
+  void loadSnapshotCache();
+  void saveSnapshotCache() const;
+
   EnumMap<FXName, ParticleSystemDef> systemDefs;
   EnumMap<FXName, vector<SnapshotGroup>> snapshotGroups;
+  struct CachedSnapshots {
+    size_t hash;
+    vector<SnapshotGroup> groups;
+  };
+  optional<FilePath> snapshotCachePath;
+  EnumMap<FXName, optional<CachedSnapshots>> cachedSnapshots;
+  EnumMap<FXName, optional<size_t>> snapshotHashes;
+  bool snapshotCacheChanged = false;
   EnumMap<TextureName, TextureDef> textureDefs;
 
   // TODO: add simple statistics: num particles, instances, etc.
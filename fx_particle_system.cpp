@@ -98,6 +98,33 @@ void defaultAnimateParticle(AnimationContext &ctx, Particle &pinst) {
   pinst.life += ctx.timeDelta;
 }
 
+void defaultAnimateParticles(AnimationContext &ctx, vector<Particle> &particles) {
+  const auto &slowdownCurve = ctx.pdef.slowdown;
+  if (!slowdownCurve.isConstant()) {
+    for (auto &pinst : particles)
+      defaultAnimateParticle(ctx, pinst);
+    return;
+  }
+  // With a constant slowdown the curve and pow() are evaluated once for the whole subsystem
+  float timeDelta = ctx.timeDelta;
+  float slowdown = 1.0f / (1.0f + slowdownCurve.sample(0.0f));
+  if (slowdown < 1.0f) {
+    float factor = pow(slowdown, timeDelta);
+    for (auto &pinst : particles) {
+      pinst.pos += pinst.movement * timeDelta;
+      pinst.rot += pinst.rotSpeed * timeDelta;
+      pinst.movement *= factor;
+      pinst.rotSpeed *= factor;
+      pinst.life += timeDelta;
+    }
+  } else
+    for (auto &pinst : particles) {
+      pinst.pos += pinst.movement * timeDelta;
+      pinst.rot += pinst.rotSpeed * timeDelta;
+      pinst.life += timeDelta;
+    }
+}
+
 float defaultPrepareEmission(AnimationContext &ctx, EmissionState &em) {
   auto &pdef = ctx.pdef;
   auto &edef = ctx.edef;
@@ -356,13 +356,19 @@ void Game::initializeModels(ProgressMeter& meter) {
   // Give every model a couple of turns so that things like shopkeepers can initialize.
   for (Vec2 v : models.getBounds())
     if (auto model = models[v].get()) {
-      for (auto c : model->getAllCreatures()) {
-        //c->tick(); Ticking crashes if it's a player and it dies. It was most likely only an optimization
-        auto level = c->getPosition().getLevel();
-        level->getSectors(c->getMovementType());
-        level->getSectors(c->getMovementType().setForced());
-        level->getSectors(MovementType(MovementTrait::WALK).setForced());
-        level->getSectors(MovementType(MovementTrait::FLY));
+      // Sectors of other sites are built lazily, when a site is visited or its creatures start moving.
+      if (model == getCurrentModel()) {
+        // Plain walking sectors are needed by Position::updateConnectivity to detect movement changes.
+        for (auto level : model->getLevels())
+          level->getSectors({MovementTrait::WALK});
+        for (auto c : model->getAllCreatures()) {
+          //c->tick(); Ticking crashes if it's a player and it dies. It was most likely only an optimization
+          auto level = c->getPosition().getLevel();
+          level->getSectors(c->getMovementType());
+          level->getSectors(c->getMovementType().setForced());
+          level->getSectors(MovementType(MovementTrait::WALK).setForced());
+          level->getSectors(MovementType(MovementTrait::FLY));
+        }
       }
       // Use top level's id as unique id of the model.
       auto id = model->getGroundLevel()->getUniqueId();
@@ -87,3 +87,29 @@ const char* GameConfig::getConfigName(GameConfigId id) {
 
 GameConfig::GameConfig(vector<DirectoryPath> modDirs) : dirs(std::move(modDirs)) {
 }
+
+size_t GameConfig::getContentHash() const {
+  vector<string> contents;
+  auto addFile = [&] (const FilePath& file) {
+    contents.push_back(file.getPath());
+    contents.push_back(file.readContents().value_or(""));
+  };
+  for (auto& dir : dirs) {
+    for (auto id : ENUM_ALL(GameConfigId)) {
+      auto path = dir.file(getConfigName(id) + ".txt"_s);
+      if (path.exists())
+        addFile(path);
+    }
+    auto layouts = dir.subdirectory("map_layouts");
+    auto subdirs = layouts.getSubDirs();
+    std::sort(subdirs.begin(), subdirs.end());
+    for (auto& subdir : subdirs) {
+      auto files = layouts.subdirectory(subdir).getFiles();
+      std::sort(files.begin(), files.end(),
+          [](const FilePath& f1, const FilePath& f2) { return strcmp(f1.getPath(), f2.getPath()) < 0; });
+      for (auto& file : files)
+        addFile(file);
+    }
+  }
+  return combineHash(contents);
+}
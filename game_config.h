@@ -65,5 +65,7 @@ class GameConfig {
   }
 
   static const char* getConfigName(GameConfigId);
+  // Hash of the paths and contents of all files read by ContentFactory::readData.
+  size_t getContentHash() const;
   vector<DirectoryPath> dirs;
 };
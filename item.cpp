@@ -219,9 +219,12 @@ void Item::tick(Position position, bool carried) {
     attributes->carriedTickEffect->apply(position);
 }
 
+static std::atomic<int> modifierGeneration(0);
+
 void Item::applyPrefix(const ItemPrefix& prefix, const ContentFactory* factory) {
   modViewObject().setModifier(ViewObject::Modifier::AURA);
   ::applyPrefix(factory, prefix, *attributes);
+  ++modifierGeneration;
   updateAbility(factory);
 }
 
@@ -671,8 +674,13 @@ bool Item::isConflictingEquipment(const Item* other) const {
   return other != this && (impl(this, other) || impl(other, this));
 }
 
+int Item::getModifierGeneration() {
+  return modifierGeneration;
+}
+
 void Item::addModifier(AttrType type, int value) {
   attributes->modifiers[type] += value;
+  ++modifierGeneration;
 }
 
 const HashMap<AttrType, int>& Item::getModifierValues() const {
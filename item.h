@@ -96,6 +96,8 @@ class Item : public Renderable, public UniqueEntity<Item>, public OwnedObject<It
   bool isConflictingEquipment(const Item*) const;
   void addModifier(AttrType, int value);
   int getModifier(AttrType) const;
+  // Increased whenever the modifiers of any item change, so that cached attribute bonuses can be dropped.
+  static int getModifierGeneration();
   const HashMap<AttrType, int>& getModifierValues() const;
   const HashMap<AttrType, pair<int, CreaturePredicate>>& getSpecialModifiers() const;
   void tick(Position, bool carried);
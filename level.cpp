@@ -49,6 +49,10 @@
 #include "portals.h"
 #include "effect_type.h"
 #include "content_factory.h"
+#include "sim_timer.h"
+#include "shortest_path.h"
+#include "tile_gas.h"
+#include "movement_set.h"
 
 template <class Archive>
 void Level::serialize(Archive& ar, const unsigned int version) {
@@ -74,12 +78,18 @@ void Level::serialize(Archive& ar, const unsigned int version) {
       CHECK(!table);
       table = std::move(elem.second);
     }
+  if (version >= 2)
+    ar(tileGas);
+  else if (Archive::is_loading::value) {
+    tileGas.reset(TileGas(squares->getBounds()));
+    for (auto v : squares->getBounds())
+      if (auto& square = squares->modified[v])
+        square->moveLegacyGas(v, *tileGas);
+  }
   // ar(furnitureEffects)
-  if (Archive::is_loading::value) {
-    // some code requires these Sectors to be always initialized
-    getSectors({MovementTrait::WALK});
+  // Sectors aren't built here, so sites that are never visited after loading don't pay for them.
+  if (Archive::is_loading::value)
     updateTickingFurniture();
-  }
   if (progressMeter)
     progressMeter->addProgress();
 }
@@ -130,7 +140,7 @@ static vector<pair<int, CreatureBucketMap>> getSwarmMaps(Vec2 size) {
 
 Level::Level(Private, SquareArray s, FurnitureArray f, Model* m, Table<double> sun, LevelId id)
     : territory(s.getBounds(), nullptr), squares(std::move(s)), furniture(std::move(f)),
-      memoryUpdates(squares->getBounds(), true), model(m),
+      memoryUpdates(squares->getBounds(), true), tileGas(squares->getBounds()), model(m),
       sunlight(sun),
       bucketMap(squares->getBounds().getSize(), FieldOfView::sightRange),
       swarmMaps(getSwarmMaps(squares->getBounds().getSize())),
@@ -242,6 +252,7 @@ void Level::updateVisibility(Vec2 changedSquare) {
   }
   for (VisionId vision : ENUM_ALL(VisionId))
     getFieldOfView(vision).squareChanged(changedSquare);
+  tileGas->updateReceiving(Position(changedSquare, this));
   for (Vec2 pos : allVisible) {
     addLightSource(pos, Position(pos, this).getLightEmission(), 1);
     updateCreatureLight(pos, 1);
@@ -580,10 +591,16 @@ void Level::addBurningFurniture(Vec2 pos, FurnitureLayer layer) {
   burningFurniture.insert(make_pair(pos, layer));
 }
 
+void Level::addPermanentGas(TileGasType type, Vec2 pos) {
+  tileGas->addPermanentAmount(pos, type, 1);
+}
+
 void Level::tick() {
   PROFILE_BLOCK("Level::tick");
+  SIM_TIMER(SimTimerId::LEVEL_TICK);
   for (Vec2 pos : tickingSquares)
     squares->getWritable(pos)->tick(Position(pos, this));
+  tileGas->tick(this);
   auto& furnitureFactory = getGame()->getContentFactory()->furniture;
   for (auto& elem : tickingFurniture)
     if (auto f = furniture->getBuilt(elem.first.second).getWritable(elem.first.first)) {
@@ -646,10 +663,6 @@ const Rectangle& Level::getBounds() const {
   return squares->getBounds();
 }
 
-Sectors& Level::getSectorsDontCreate(const MovementType& movement) const {
-  return sectors.at(movement);
-}
-
 static Sectors::ExtraConnections getOrCreateExtraConnections(Rectangle bounds,
     const HashMap<MovementType, Sectors>& sectors) {
   if (sectors.empty())
@@ -658,8 +671,30 @@ static Sectors::ExtraConnections getOrCreateExtraConnections(Rectangle bounds,
     return sectors.begin()->second.getExtraConnections();
 }
 
-Sectors& Level::getSectors(const MovementType& movement) const {
+EnumSet<MovementDependency> Level::getMovementDependencies(Vec2 pos) const {
+  EnumSet<MovementDependency> ret;
+  for (auto layer : ENUM_ALL(FurnitureLayer))
+    if (auto f = furniture->getBuilt(layer).getReadonly(pos))
+      ret = ret.sum(f->getMovementSet().getDependencies());
+  // Gas can only cover a square, so checking the static cover is enough here.
+  if (!Position(pos, getThis().removeConst().get()).isCovered())
+    ret.insert(MovementDependency::SUNLIGHT);
+  auto square = getSafeSquare(pos);
+  if (square->isOnFire())
+    ret.insert(MovementDependency::FIRE);
+  if (square->getForbiddenTribe())
+    ret.insert(MovementDependency::TRIBE);
+  return ret;
+}
+
+Sectors& Level::getSectors(const MovementType& movementArg) const {
   PROFILE;
+  if (!movementDependencies) {
+    movementDependencies.emplace();
+    for (Vec2 v : getBounds())
+      movementDependencies->sumWith(getMovementDependencies(v));
+  }
+  auto movement = movementArg.getCanonical(*movementDependencies);
   if (auto res = getReferenceMaybe(sectors, movement))
     return *res;
   else {
@@ -676,6 +711,14 @@ Sectors& Level::getSectors(const MovementType& movement) const {
   }
 }
 
+FlowFieldCache& Level::getFlowFields() const {
+  return *flowFields;
+}
+
+std::mutex& Level::getPathMutex() const {
+  return pathMutex;
+}
+
 void Level::prepareForRetirement() {
   for (auto l : ENUM_ALL(FurnitureLayer))
     furniture->getBuilt(l).clearModified();
@@ -685,6 +728,7 @@ void Level::updateSunlightMovement() {
   for (auto movement : getKeys(sectors))
     if (movement.isSunlightVulnerable())
       sectors.erase(movement);
+  flowFields->clear();
 }
 
 int Level::getNumGeneratedSquares() const {
@@ -711,6 +755,10 @@ bool Level::needsRenderUpdate(Vec2 pos) const {
 
 void Level::setNeedsRenderUpdate(Vec2 pos, bool s) {
   renderUpdates[pos] = s;
+  // Levels above show this square through their unavailable squares.
+  if (s)
+    for (auto l = above; !!l && l->unavailable[pos]; l = l->above)
+      l->renderUpdates[pos] = s;
 }
 
 bool Level::needsMemoryUpdate(Vec2 pos) const {
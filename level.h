@@ -27,6 +27,7 @@
 #include "creature_list.h"
 #include "lasting_or_buff.h"
 #include "t_string.h"
+#include "tile_gas_type.h"
 
 class Model;
 class Square;
@@ -35,6 +36,7 @@ class LevelMaker;
 class Attack;
 class ProgressMeter;
 class Sectors;
+class FlowFieldCache;
 class Tribe;
 class Attack;
 class PlayerMessage;
@@ -45,6 +47,7 @@ class SquareArray;
 class FurnitureArray;
 class Vision;
 class FieldOfView;
+class TileGas;
 class ContentFactory;
 struct PhylacteryInfo;
 
@@ -108,6 +111,7 @@ class Level : public OwnedObject<Level> {
   void addTickingSquare(Vec2 pos);
   void addTickingFurniture(Vec2 pos, FurnitureLayer);
   void addBurningFurniture(Vec2 pos, FurnitureLayer);
+  void addPermanentGas(TileGasType, Vec2 pos);
 
   void tick();
 
@@ -155,6 +159,9 @@ class Level : public OwnedObject<Level> {
   void setFurniture(Vec2, PFurniture);
 
   Sectors& getSectors(const MovementType&) const;
+  FlowFieldCache& getFlowFields() const;
+  // Guards the sectors and flow fields, which are built lazily, while paths on this level are computed concurrently.
+  std::mutex& getPathMutex() const;
   struct EffectSet {
     vector<LastingOrBuff> SERIAL(friendly);
     vector<LastingOrBuff> SERIAL(hostile);
@@ -181,6 +188,7 @@ class Level : public OwnedObject<Level> {
   friend class Position;
   const Square* getSafeSquare(Vec2) const;
   Square* modSafeSquare(Vec2);
+  EnumSet<MovementDependency> getMovementDependencies(Vec2) const;
   HeapAllocated<SquareArray> SERIAL(squares);
   HeapAllocated<FurnitureArray> SERIAL(furniture);
   Table<bool> SERIAL(memoryUpdates);
@@ -188,6 +196,7 @@ class Level : public OwnedObject<Level> {
   Table<bool> SERIAL(unavailable);
   LandingSquares SERIAL(landingSquares);
   set<Vec2> SERIAL(tickingSquares);
+  HeapAllocated<TileGas> SERIAL(tileGas);
   HashMap<pair<Vec2, FurnitureLayer>, double> tickingFurniture;
   HashSet<pair<Vec2, FurnitureLayer>> burningFurniture;
   void placeCreature(Creature*, Vec2 pos);
@@ -203,8 +212,11 @@ class Level : public OwnedObject<Level> {
   Table<double> SERIAL(lightAmount);
   Table<double> SERIAL(lightCapAmount);
   EnumMap<TribeId::KeyType, unique_ptr<EffectsTable>> SERIAL(furnitureEffects);
+  // Sectors are keyed by MovementType::getCanonical() applied to the dependencies present on the level.
   mutable HashMap<MovementType, Sectors> sectors;
-  Sectors& getSectorsDontCreate(const MovementType&) const;
+  mutable optional<EnumSet<MovementDependency>> movementDependencies;
+  mutable HeapAllocated<FlowFieldCache> flowFields;
+  mutable std::mutex pathMutex;
 
   friend class LevelBuilder;
   struct Private {};
@@ -231,4 +243,4 @@ class Level : public OwnedObject<Level> {
   void updateTickingFurniture();
 };
 
-CEREAL_CLASS_VERSION(Level, 1)
\ No newline at end of file
+CEREAL_CLASS_VERSION(Level, 2)
\ No newline at end of file
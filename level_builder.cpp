@@ -189,9 +189,9 @@ PLevel LevelBuilder::build(const ContentFactory* factory, Model* m, LevelMaker*
   for (Vec2 v : squares.getBounds())
     if (!items[v].empty())
       squares.getWritable(v)->dropItemsLevelGen(std::move(items[v]));
-  for (auto& elem : permanentGas)
-    squares.getWritable(elem.second)->addPermanentGas(elem.first, 1);
   auto l = Level::create(std::move(squares), std::move(furniture), m, sunlight, levelId, covered, unavailable, factory);
+  for (auto& elem : permanentGas)
+    l->addPermanentGas(elem.first, elem.second);
   for (pair<PCreature, Vec2>& c : creatures) {
     Position pos(c.second, l.get());
     /*CHECK(pos.canEnter(c.first.get())) << c.first->getName().bare();
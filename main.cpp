@@ -60,6 +60,8 @@
 #include "steam_achievements.h"
 
 #include "stack_printer.h"
+#include "shortest_path.h"
+#include "field_of_view.h"
 
 #ifdef USE_STEAMWORKS
 #include "steam_base.h"
@@ -136,6 +138,21 @@ static po::parser getCommandLineFlags() {
   flags["endless_enemy"].type(po::string).description("Endless mode enemy index");
   flags["battle_view"].description("Open game window and display battle");
   flags["battle_rounds"].type(po::i32).description("Number of battle rounds");
+  flags["battle_threads"].type(po::i32).description("Number of threads running headless battles in parallel");
+  flags["battle_seed"].type(po::i32).description("Random seed of the first headless battle");
+  flags["battle_report"].type(po::string).description("Path to the CSV report with the result of every headless battle");
+  flags["bench_sim"].type(po::string).description("Run a headless simulation benchmark on a save file or a new single map game with the given keeper");
+  flags["bench_turns"].type(po::i32).description("Number of turns to simulate in the benchmark");
+  flags["bench_seed"].type(po::i32).description("Random seed used in the benchmark");
+  flags["bench_report"].type(po::string).description("Path to the benchmark CSV report with per turn timings");
+  flags["bench_paths"].type(po::string).description("Benchmark path finding engines on random paths in a save file or a new single map game with the given keeper");
+  flags["bench_num_paths"].type(po::i32).description("Number of paths computed in the path finding benchmark");
+  flags["bench_fx"].type(po::i32).description("Benchmark particle simulation of all effects, with the given number of instances of each");
+  flags["bench_frames"].type(po::i32).description("Number of frames simulated in the particle benchmark");
+  flags["bench_save"].type(po::string).description("Benchmark saving and loading a save file or a new single map game with the given keeper");
+  flags["bench_num_saves"].type(po::i32).description("Number of times the game is saved and loaded in the save benchmark");
+  flags["fov_cache_mb"].type(po::i32).description("Memory limit of the field of view cache in megabytes");
+  flags["path_queue"].type(po::string).description("Priority queue used by path finding: binary_heap or buckets");
   flags["layout_size"].type(po::string).description("Size of the generated map layout");
   flags["layout_name"].type(po::string).description("Name of layout to generate");
   flags["stderr"].description("Log to stderr");
@@ -281,6 +298,13 @@ static int keeperMain(po::parser& commandLineFlags) {
   }
   if (commandLineFlags["new_game"].was_set())
     USER_CHECK(!commandLineFlags["new_game"].get().string.empty()) << "Please enter keeper name";
+  if (commandLineFlags["fov_cache_mb"].was_set())
+    FieldOfView::setMemoryLimit((long long) commandLineFlags["fov_cache_mb"].get().i32 * 1024 * 1024);
+  if (commandLineFlags["path_queue"].was_set()) {
+    auto type = EnumInfo<PathQueueType>::fromStringSafe(toUpper(commandLineFlags["path_queue"].get().string));
+    USER_CHECK(!!type) << "Unknown path queue type: " << commandLineFlags["path_queue"].get().string;
+    ShortestPath::setQueueType(*type);
+  }
   DirectoryPath dataPath([&]() -> string {
     if (commandLineFlags["data_dir"].was_set())
       return commandLineFlags["data_dir"].get().string;
@@ -393,11 +417,54 @@ static int keeperMain(po::parser& commandLineFlags) {
     loop.modelGenTest(commandLineFlags["worldgen_test"].get().i32, types, Random, &options);
     return 0;
   }
+  if (commandLineFlags["bench_sim"].was_set()) {
+    DummyView view(&clock);
+    MainLoop loop(&view, &highscores, &fileSharing, paidDataPath, freeDataPath, userPath, modsDir, &options, nullptr,
+        &sokobanInput, nullptr, &allUnlocked, nullptr, nullptr, saveVersion, modVersion);
+    auto numTurns = commandLineFlags["bench_turns"].was_set() ? commandLineFlags["bench_turns"].get().i32 : 500;
+    auto seed = commandLineFlags["bench_seed"].was_set() ? commandLineFlags["bench_seed"].get().i32 : 1;
+    auto reportPath = commandLineFlags["bench_report"].was_set() ? commandLineFlags["bench_report"].get().string
+        : "bench_sim.csv"_s;
+    try {
+      loop.benchSim(commandLineFlags["bench_sim"].get().string, numTurns, seed, FilePath::fromFullPath(reportPath));
+    } catch (GameExitException) {}
+    return 0;
+  }
+  if (commandLineFlags["bench_paths"].was_set()) {
+    DummyView view(&clock);
+    MainLoop loop(&view, &highscores, &fileSharing, paidDataPath, freeDataPath, userPath, modsDir, &options, nullptr,
+        &sokobanInput, nullptr, &allUnlocked, nullptr, nullptr, saveVersion, modVersion);
+    auto numPaths = commandLineFlags["bench_num_paths"].was_set() ? commandLineFlags["bench_num_paths"].get().i32 : 1000;
+    auto seed = commandLineFlags["bench_seed"].was_set() ? commandLineFlags["bench_seed"].get().i32 : 1;
+    loop.benchPaths(commandLineFlags["bench_paths"].get().string, numPaths, seed);
+    return 0;
+  }
+  if (commandLineFlags["bench_fx"].was_set()) {
+    fx::FXManager fxManager;
+    auto numFrames = commandLineFlags["bench_frames"].was_set() ? commandLineFlags["bench_frames"].get().i32 : 600;
+    fxManager.benchmark(commandLineFlags["bench_fx"].get().i32, numFrames);
+    return 0;
+  }
+  if (commandLineFlags["bench_save"].was_set()) {
+    DummyView view(&clock);
+    MainLoop loop(&view, &highscores, &fileSharing, paidDataPath, freeDataPath, userPath, modsDir, &options, nullptr,
+        &sokobanInput, nullptr, &allUnlocked, nullptr, nullptr, saveVersion, modVersion);
+    auto numTries = commandLineFlags["bench_num_saves"].was_set() ? commandLineFlags["bench_num_saves"].get().i32 : 3;
+    loop.benchSave(commandLineFlags["bench_save"].get().string, numTries);
+    return 0;
+  }
   auto battleTest = [&] (View* view, TileSet* tileSet) {
     MainLoop loop(view, &highscores, &fileSharing, paidDataPath, freeDataPath, userPath, modsDir, &options, nullptr,
         &sokobanInput, tileSet,  &allUnlocked, nullptr, nullptr, 0, "");
     auto level = commandLineFlags["battle_level"].get().string;
     auto numRounds = commandLineFlags["battle_rounds"].was_set() ? commandLineFlags["battle_rounds"].get().i32 : 1;
+    if (!commandLineFlags["battle_view"].was_set()) {
+      auto numThreads = commandLineFlags["battle_threads"].was_set() ? commandLineFlags["battle_threads"].get().i32 : 0;
+      auto seed = commandLineFlags["battle_seed"].was_set() ? commandLineFlags["battle_seed"].get().i32 : 1;
+      auto reportPath = commandLineFlags["battle_report"].was_set() ? commandLineFlags["battle_report"].get().string
+          : "battles.csv"_s;
+      loop.setHeadlessBattles(numThreads, seed, FilePath::fromFullPath(reportPath));
+    }
     try {
       if (commandLineFlags["endless_enemy"].was_set()) {
         auto info = commandLineFlags["battle_info"].get().string;
@@ -496,7 +563,13 @@ static int keeperMain(po::parser& commandLineFlags) {
     auto particlesPath = paidDataPath.subdirectory("images").subdirectory("particles");
     if (particlesPath.exists()) {
       INFO << "FX: initialization";
-      fxManager = make_unique<fx::FXManager>();
+      // Snapshots are keyed on the build version, which doesn't change when animation code is edited locally,
+      // so the disk cache is only used in release builds.
+      optional<FilePath> fxSnapshotCache;
+  #ifdef RELEASE
+      fxSnapshotCache = userPath.file("fx_snapshots.bin");
+  #endif
+      fxManager = make_unique<fx::FXManager>(fxSnapshotCache);
       fxRenderer = make_unique<fx::FXRenderer>(particlesPath, *fxManager);
       fxRenderer->loadTextures();
       fxViewManager = make_unique<FXViewManager>(fxManager.get(), fxRenderer.get());
@@ -35,6 +35,7 @@
 #include "enemy_factory.h"
 #include "external_enemies.h"
 #include "game_config.h"
+#include "retired_site_index.h"
 #include "avatar_menu_option.h"
 #include "creature_name.h"
 #include "tileset.h"
@@ -58,6 +59,11 @@
 #include "scripted_ui_data.h"
 #include "version.h"
 #include "collective.h"
+#include "sim_timer.h"
+#include "shortest_path.h"
+#include "movement_type.h"
+#include "field_of_view.h"
+#include "dummy_view.h"
 
 #ifdef USE_STEAMWORKS
 #include "steam_ugc.h"
@@ -111,6 +117,15 @@ bool MainLoop::useSingleThread() {
   return options->getBoolValue(OptionId::SINGLE_THREAD);
 }
 
+// Starting with this version, content ids after the save header are written through a ContentIdTable.
+static const int firstContentIdTableVersion = 8112;
+
+static unique_ptr<ContentIdTable> getContentIdTable(const void* archive, int version) {
+  if (version >= firstContentIdTableVersion)
+    return make_unique<ContentIdTable>(archive);
+  return nullptr;
+}
+
 template <typename T>
 optional<T> MainLoop::loadFromFile(const FilePath& filename) {
   auto f = [&] {
@@ -120,6 +135,7 @@ optional<T> MainLoop::loadFromFile(const FilePath& filename) {
     SavedGameInfo discard2;
     int version;
     input.getArchive() >> version >> discard >> discard2;
+    auto idTable = getContentIdTable(&input.getArchive(), version);
     input.getArchive() >> obj;
     return std::move(obj);
   };
@@ -135,16 +151,50 @@ optional<T> MainLoop::loadFromFile(const FilePath& filename) {
 void MainLoop::saveGame(PGame& game, const FilePath& path) {
   FilePath tmpPath = path.withSuffix(".tmp");
   {
-    CompressedOutput out(tmpPath.getPath());
+    ChunkedCompressedOutput out(tmpPath.getPath());
     string name = toString(game->getGameDisplayName());
     SavedGameInfo savedInfo = game->getSavedGameInfo(tileSet->getSpriteMods());
     out.getArchive() << saveVersion << name << savedInfo;
+    auto idTable = getContentIdTable(&out.getArchive(), saveVersion);
     out.getArchive() << game;
   }
+  if (!tmpPath.exists()) {
+    INFO << "Failed to write the save file " << path;
+    return;
+  }
   tmpPath.copyTo(path);
   tmpPath.erase();
 }
 
+void MainLoop::saveGameInBackground(PGame& game, const FilePath& path) {
+  waitForBackgroundSave();
+  // Only serialization, which needs a consistent game state, happens here. Compression and writing the file
+  // happen on a separate thread while the game continues. The resulting file is the same as from saveGame.
+  auto buffer = make_shared<ChunkedOutputStream>();
+  {
+    OutputArchive archive(*buffer);
+    string name = toString(game->getGameDisplayName());
+    SavedGameInfo savedInfo = game->getSavedGameInfo(tileSet->getSpriteMods());
+    archive << saveVersion << name << savedInfo;
+    auto idTable = getContentIdTable(&archive, saveVersion);
+    archive << game;
+  }
+  backgroundSave = makeThread([buffer, path] {
+    FilePath tmpPath = path.withSuffix(".tmp");
+    if (!buffer->writeFile(tmpPath.getPath())) {
+      INFO << "Failed to write the save file " << path;
+      return;
+    }
+    tmpPath.copyTo(path);
+    tmpPath.erase();
+  });
+}
+
+void MainLoop::waitForBackgroundSave() {
+  if (backgroundSave.joinable())
+    backgroundSave.join();
+}
+
 struct RetiredModelInfo {
   shared_ptr<Model> SERIAL(model);
   ContentFactory SERIAL(factory);
@@ -164,21 +214,32 @@ optional<RetiredModelInfo> MainLoop::loadRetiredModelFromFile(const FilePath& pa
   return loadFromFile<RetiredModelInfo>(path);
 }
 
+RetiredSiteIndex MainLoop::getRetiredSiteIndex() const {
+  return RetiredSiteIndex(userPath, getSaveSuffix(GameSaveType::RETIRED_SITE), saveVersion);
+}
+
 void MainLoop::saveMainModel(PGame& game, const FilePath& modelPath) {
   FilePath tmpPath = modelPath.withSuffix(".tmp");
+  SavedGameInfo savedInfo = game->getSavedGameInfo(tileSet->getSpriteMods());
   {
-    CompressedOutput modelOut(tmpPath.getPath());
+    ChunkedCompressedOutput modelOut(tmpPath.getPath());
     string name = toString(game->getGameDisplayName());
-    SavedGameInfo savedInfo = game->getSavedGameInfo(tileSet->getSpriteMods());
     modelOut.getArchive() << saveVersion << name << savedInfo;
+    auto idTable = getContentIdTable(&modelOut.getArchive(), saveVersion);
     RetiredModelInfoWithReference info {
       game->getMainModel().giveMeSharedPointer(),
       game->getContentFactory()
     };
     modelOut.getArchive() << info;
   }
+  if (!tmpPath.exists()) {
+    INFO << "Failed to write the save file " << modelPath;
+    return;
+  }
   tmpPath.copyTo(modelPath);
   tmpPath.erase();
+  if (modelPath.hasSuffix(getSaveSuffix(GameSaveType::RETIRED_SITE)))
+    getRetiredSiteIndex().add(modelPath, saveVersion, savedInfo);
 }
 
 int MainLoop::getSaveVersion(const SaveFileInfo& save) {
@@ -213,6 +274,7 @@ FilePath MainLoop::getSavePath(const PGame& game, GameSaveType gameType) {
 }
 
 void MainLoop::saveUI(PGame& game, GameSaveType type) {
+  waitForBackgroundSave();
   auto path = getSavePath(game, type);
   function<void()> uploadFun = nullptr;
   if (type == GameSaveType::RETIRED_SITE) {
@@ -241,7 +303,12 @@ void MainLoop::saveUI(PGame& game, GameSaveType type) {
 }
 
 void MainLoop::eraseSaveFile(const PGame& game, GameSaveType type) {
-  getSavePath(game, type).erase();
+  auto path = getSavePath(game, type);
+  if (type == GameSaveType::AUTOSAVE)
+    waitForBackgroundSave();
+  if (type == GameSaveType::RETIRED_SITE && path.exists())
+    getRetiredSiteIndex().remove(path);
+  path.erase();
 }
 
 enum class MainLoop::ExitCondition {
@@ -274,6 +341,7 @@ MainLoop::ExitCondition MainLoop::playGame(PGame game, bool withMusic, bool noAu
     function<optional<ExitCondition>(Game*)> exitCondition, milliseconds stepTimeMilli, optional<int> maxTurns) {
   registerModPlaytime(true);
   OnExit on_exit([&]() {
+    waitForBackgroundSave();
     registerModPlaytime(false);
   });
   if (tileSet)
@@ -347,7 +415,10 @@ MainLoop::ExitCondition MainLoop::playGame(PGame game, bool withMusic, bool noAu
     }
     auto autoSaveFreq = options->getIntValue(OptionId::AUTOSAVE2);
     if (autoSaveFreq > 0 && lastAutoSave < gameTime - TimeInterval(autoSaveFreq) && !noAutoSave) {
-      saveUI(game, GameSaveType::AUTOSAVE);
+      if (useSingleThread())
+        saveUI(game, GameSaveType::AUTOSAVE);
+      else
+        MEASURE(saveGameInBackground(game, getSavePath(game, GameSaveType::AUTOSAVE)), "autosave serialization");
       eraseAllSavesExcept(game, GameSaveType::AUTOSAVE);
       lastAutoSave = gameTime;
     }
@@ -369,11 +440,9 @@ optional<RetiredGames> MainLoop::getRetiredGames(CampaignType type) {
         if (isCompatible(getSaveVersion(info)))
           if (auto saved = loadSavedGameInfo(userPath.file(info.filename)))
             ret.addLocal(*saved, info, true);
-      for (auto& info : getSaveFiles(userPath, getSaveSuffix(GameSaveType::RETIRED_SITE)))
-        if (isCompatible(getSaveVersion(info)))
-          if (auto saved = loadSavedGameInfo(userPath.file(info.filename)))
-            if (!saved->retiredEnemyInfo)
-              ret.addLocal(*saved, info, false);
+      for (auto& entry : getRetiredSiteIndex().getEntries())
+        if (isCompatible(entry.version) && !entry.info.retiredEnemyInfo)
+          ret.addLocal(entry.info, SaveFileInfo{entry.filename, time_t(entry.date), false}, false);
       vector<FileSharing::SiteInfo> onlineSites;
       optional<string> error;
       FileSharing::CancelFlag cancel;
@@ -923,12 +992,78 @@ GameConfig MainLoop::getGameConfig(const vector<string>& modNames) const {
       .transform([&](const string& name) { return modsDir.subdirectory(name); })));
 }
 
+#ifdef RELEASE
+struct ContentCacheHeader {
+  string SERIAL(buildVersion);
+  int SERIAL(saveVersion);
+  size_t SERIAL(contentHash);
+  SERIALIZE_ALL_NO_VERSION(buildVersion, saveVersion, contentHash)
+};
+
+static bool loadContentCache(const FilePath& path, const ContentCacheHeader& header, ContentFactory& factory) {
+  if (!path.exists())
+    return false;
+  try {
+    ifstream input(path.getPath(), std::ios::binary);
+    InputArchive archive(input);
+    ContentCacheHeader cachedHeader;
+    archive(cachedHeader);
+    if (cachedHeader.buildVersion != header.buildVersion || cachedHeader.saveVersion != header.saveVersion ||
+        cachedHeader.contentHash != header.contentHash)
+      return false;
+    archive(factory);
+    return true;
+  } catch (std::exception& e) {
+    INFO << "Failed to load content cache " << path << ": " << e.what();
+    return false;
+  }
+}
+
+static void saveContentCache(const FilePath& path, const ContentCacheHeader& header, const ContentFactory& factory) {
+  auto tmpPath = path.withSuffix(".tmp");
+  {
+    ofstream output(tmpPath.getPath(), std::ios::binary);
+    {
+      OutputArchive archive(output);
+      archive(header, factory);
+    }
+    output.close();
+    if (!output) {
+      INFO << "Failed to write content cache " << tmpPath;
+      tmpPath.erase();
+      return;
+    }
+  }
+  tmpPath.copyTo(path);
+  tmpPath.erase();
+}
+#endif
+
 ContentFactory MainLoop::createContentFactory(bool vanillaOnly) const {
   ContentFactory ret;
-  auto tryConfig = [&](const vector<string>& modNames) {
+  // Parsed content is cached in binary form, separately for every mod combination, and reused as long as
+  // the config files and the game build haven't changed. The build version doesn't change when the code is
+  // edited locally, so the cache is only used in release builds.
+#ifdef RELEASE
+  auto cacheDir = userPath.subdirectory("content_cache");
+  cacheDir.createIfDoesntExist();
+#endif
+  auto tryConfig = [&](const vector<string>& modNames) -> optional<string> {
     ret = ContentFactory();
     auto config = getGameConfig(modNames);
-    return ret.readData(&config, modNames);
+#ifdef RELEASE
+    auto cachePath = cacheDir.file(toString(combineHash(modNames)) + ".bin");
+    auto header = ContentCacheHeader{string(BUILD_DATE) + " " + BUILD_VERSION, saveVersion, config.getContentHash()};
+    if (loadContentCache(cachePath, header, ret))
+      return none;
+    ret = ContentFactory();
+#endif
+    if (auto error = ret.readData(&config, modNames))
+      return error;
+#ifdef RELEASE
+    saveContentCache(cachePath, header, ret);
+#endif
+    return none;
   };
   if (vanillaOnly) {
 #ifdef RELEASE
@@ -980,24 +1115,177 @@ void MainLoop::launchQuickGame(optional<int> maxTurns, optional<string> keeperNa
     } else
       return;
   } else {
-    auto& keeperCreature = [&] ()-> const KeeperCreatureInfo& {
-      for (auto& elem : contentFactory.keeperCreatures)
-        if (elem.first == keeperName)
-          return elem.second;
-      USER_FATAL << "keeper not found " << *keeperName;
-      fail();
-    }();
-    AvatarInfo avatar = getQuickGameAvatar(view, keeperCreature, &contentFactory.getCreatures());
-    CampaignBuilder builder(view, Random, options, contentFactory.villains, contentFactory.gameIntros, avatar);
-    auto result = builder.prepareCampaign(&contentFactory, bindMethod(&MainLoop::getRetiredGames, this),
-        CampaignType::QUICK_MAP, "Jarnsaxaland");
-    auto models = prepareCampaignModels(*result, std::move(avatar), Random, &contentFactory);
-    game = Game::campaignGame(std::move(models.models), *result, std::move(avatar), std::move(contentFactory), {});
+    game = prepareQuickGame(std::move(contentFactory), *keeperName);
     dumpMemUsage(game);
   }
   playGame(std::move(game), true, false, nullptr, milliseconds{3}, maxTurns);
 }
 
+PGame MainLoop::prepareQuickGame(ContentFactory contentFactory, const string& keeperName) {
+  auto& keeperCreature = [&] ()-> const KeeperCreatureInfo& {
+    for (auto& elem : contentFactory.keeperCreatures)
+      if (elem.first == keeperName)
+        return elem.second;
+    USER_FATAL << "keeper not found " << keeperName;
+    fail();
+  }();
+  AvatarInfo avatar = getQuickGameAvatar(view, keeperCreature, &contentFactory.getCreatures());
+  CampaignBuilder builder(view, Random, options, contentFactory.villains, contentFactory.gameIntros, avatar);
+  auto result = builder.prepareCampaign(&contentFactory, bindMethod(&MainLoop::getRetiredGames, this),
+      CampaignType::QUICK_MAP, "Jarnsaxaland");
+  auto models = prepareCampaignModels(*result, std::move(avatar), Random, &contentFactory);
+  return Game::campaignGame(std::move(models.models), *result, std::move(avatar), std::move(contentFactory), {});
+}
+
+PGame MainLoop::prepareBenchGame(const string& saveOrKeeper, int seed) {
+  Random.init(seed);
+  auto savePath = FilePath::fromFullPath(saveOrKeeper);
+  PGame game = savePath.exists()
+      ? loadGame(savePath, TString(saveOrKeeper))
+      : prepareQuickGame(createContentFactory(true), saveOrKeeper);
+  USER_CHECK(!!game) << "Failed to prepare benchmark game from " << saveOrKeeper;
+  return game;
+}
+
+void MainLoop::benchSim(const string& saveOrKeeper, int numTurns, int seed, const FilePath& reportPath) {
+  auto game = prepareBenchGame(saveOrKeeper, seed);
+  Encyclopedia encyclopedia(game->getContentFactory());
+  game->initialize(options, highscores, view, fileSharing, &encyclopedia, unlocks, steamAchievements);
+  ProgressMeter meter(1);
+  game->initializeModels(meter);
+  // Reseed after loading so the simulation doesn't depend on how much randomness was consumed by generation.
+  Random.init(seed);
+  ofstream report(reportPath.getPath());
+  report << "turn,total_us";
+  for (auto id : ENUM_ALL(SimTimerId))
+    report << "," << toLower(EnumInfo<SimTimerId>::getString(id)) << "_us";
+  report << "\n";
+  SimTimers::setEnabled(true);
+  OnExit onExit([] { SimTimers::setEnabled(false); });
+  SimTimers::getAndClear();
+  microseconds totalTime(0);
+  EnumMap<SimTimerId, microseconds> subsystemTime;
+  int turnsDone = 0;
+  for (int turn : Range(numTurns)) {
+    auto begin = steady_clock::now();
+    auto exitInfo = game->update(1, milliseconds::max());
+    auto turnTime = duration_cast<microseconds>(steady_clock::now() - begin);
+    auto timers = SimTimers::getAndClear();
+    report << game->getGlobalTime().getVisibleInt() << "," << turnTime.count();
+    for (auto id : ENUM_ALL(SimTimerId)) {
+      report << "," << timers[id].count();
+      subsystemTime[id] += timers[id];
+    }
+    report << "\n";
+    totalTime += turnTime;
+    ++turnsDone;
+    if (exitInfo)
+      break;
+  }
+  std::cout << "Simulated " << turnsDone << " turns in " << duration_cast<milliseconds>(totalTime) << ", "
+      << totalTime.count() / max(1, turnsDone) << "us per turn\n";
+  for (auto id : ENUM_ALL(SimTimerId))
+    std::cout << EnumInfo<SimTimerId>::getString(id) << " " << duration_cast<milliseconds>(subsystemTime[id]) << "\n";
+  auto fovStats = FieldOfView::getCacheStats();
+  std::cout << "FOV cache: " << fovStats.hits << " hits, " << fovStats.misses << " misses, " << fovStats.evictions
+      << " evictions, " << fovStats.memoryUsage / 1024 << "KB used\n";
+}
+
+void MainLoop::benchPaths(const string& saveOrKeeper, int numPaths, int seed) {
+  auto game = prepareBenchGame(saveOrKeeper, seed);
+  Encyclopedia encyclopedia(game->getContentFactory());
+  game->initialize(options, highscores, view, fileSharing, &encyclopedia, unlocks, steamAchievements);
+  ProgressMeter meter(1);
+  game->initializeModels(meter);
+  Random.init(seed);
+  MovementType movement({MovementTrait::WALK});
+  vector<pair<Position, Position>> endpoints;
+  auto levels = game->getCurrentModel()->getLevels();
+  for (auto level : levels) {
+    auto positions = level->getAllPositions().filter([&](auto& pos) { return pos.canNavigate(movement); });
+    if (positions.empty())
+      continue;
+    auto& sectors = level->getSectors(movement);
+    for (int i : Range(numPaths / levels.size() + 1)) {
+      // Give up on levels where random pairs are rarely connected.
+      for (int j : Range(100)) {
+        auto from = positions[Random.get(positions.size())];
+        auto to = positions[Random.get(positions.size())];
+        if (sectors.same(from.getCoord(), to.getCoord())) {
+          endpoints.push_back(make_pair(from, to));
+          break;
+        }
+      }
+    }
+  }
+  endpoints = endpoints.getPrefix(min(endpoints.size(), numPaths));
+  auto origType = ShortestPath::getQueueType();
+  OnExit onExit([origType] { ShortestPath::setQueueType(origType); });
+  // The first pass is untimed, it builds the lazy sector data and warms up the caches.
+  for (bool timed : {false, true})
+    for (auto type : ENUM_ALL(PathQueueType)) {
+      ShortestPath::setQueueType(type);
+      int totalLength = 0;
+      auto begin = steady_clock::now();
+      for (auto& elem : endpoints) {
+        // Flow fields would make repeated targets free, so measure single searches only.
+        elem.first.getLevel()->getFlowFields().clear();
+        totalLength += LevelShortestPath(elem.first, movement, elem.second).getPath().size();
+      }
+      auto time = duration_cast<microseconds>(steady_clock::now() - begin);
+      if (timed)
+        std::cout << EnumInfo<PathQueueType>::getString(type) << ": " << endpoints.size() << " paths in "
+            << duration_cast<milliseconds>(time) << ", " << time.count() / max<int>(1, endpoints.size())
+            << "us per path, total length " << totalLength << "\n";
+    }
+}
+
+template <typename Output>
+static milliseconds benchSaveFormat(const FilePath& path, int numTries, function<void(OutputArchive&)> serialize) {
+  auto begin = steady_clock::now();
+  for (int i : Range(numTries)) {
+    Output out(path.getPath());
+    serialize(out.getArchive());
+  }
+  return duration_cast<milliseconds>(steady_clock::now() - begin) / numTries;
+}
+
+void MainLoop::benchSave(const string& saveOrKeeper, int numTries) {
+  auto game = prepareBenchGame(saveOrKeeper, 1);
+  string name = toString(game->getGameDisplayName());
+  auto savedInfo = game->getSavedGameInfo({});
+  auto serialize = [&](OutputArchive& archive) {
+    archive << saveVersion << name << savedInfo;
+    auto idTable = getContentIdTable(&archive, saveVersion);
+    archive << game;
+  };
+  auto rawSize = [&] {
+    ChunkedOutputStream stream;
+    {
+      OutputArchive archive(stream);
+      serialize(archive);
+    }
+    return stream.getSize();
+  }();
+  auto path = userPath.file("bench_save.tmp");
+  auto megabytesPerSecond = [&](milliseconds time) {
+    return double(rawSize) / 1000 / max<int>(1, time.count());
+  };
+  auto measure = [&](const char* format, milliseconds saveTime) {
+    auto begin = steady_clock::now();
+    for (int i : Range(numTries))
+      USER_CHECK(!!loadFromFile<PGame>(path)) << "Failed to load the benchmark save";
+    auto loadTime = duration_cast<milliseconds>(steady_clock::now() - begin) / numTries;
+    std::cout << format << ": " << rawSize / 1024 << "KB serialized, " << ifstream(path.getPath(),
+        std::ios::binary | std::ios::ate).tellg() / 1024 << "KB on disk, save " << saveTime << " ("
+        << megabytesPerSecond(saveTime) << " MB/s), load " << loadTime << " (" << megabytesPerSecond(loadTime)
+        << " MB/s)\n";
+  };
+  measure("gzip", benchSaveFormat<CompressedOutput>(path, numTries, serialize));
+  measure("chunked", benchSaveFormat<ChunkedCompressedOutput>(path, numTries, serialize));
+  path.erase();
+}
+
 void MainLoop::start(bool tilesPresent) {
   tileSet->setTilePathsAndReload(getTilePathsForAllMods());
   view->playVideo(paidDataPath.file("intro.ogv").getPath());
@@ -1126,7 +1414,7 @@ void MainLoop::battleTest(int numTries, const FilePath& levelPath, const FilePat
   for (int i : Range(cnt)) {
     auto allies = readAlly(input);
     std::cout << allies.getSummary(&contentFactory.getCreatures()) << ": ";
-    battleTest(numTries, levelPath, {allies}, {enemies});
+    battleTest(numTries, levelPath, contentFactory, {allies}, {enemies});
   }
 }
 
@@ -1163,7 +1451,7 @@ int MainLoop::campaignBattleText(int numTries, const FilePath& levelPath, EnemyI
       elem.increaseBaseLevel(EnumMap<ExperienceType, int>([increase](ExperienceType t) { return increase; }));
     }
     std::cerr << "Increase " << increase << std::endl;*/
-    int res = battleTest(numTries, levelPath, minions,
+    int res = battleTest(numTries, levelPath, contentFactory, minions,
         {enemy.settlement.inhabitants.fighters, enemy.settlement.inhabitants.leader});
     /*if (res >= numTries * 9 / 10)
       return increase;*/
@@ -1184,7 +1472,7 @@ void MainLoop::endlessTest(int numTries, const FilePath& levelPath, const FilePa
       int totalWins = 0;
       for (auto& allyInfo : allies) {
         //std::cerr << allyInfo.getSummary(&contentFactory.getCreatures()) << ": ";
-        int numWins = battleTest(numTries, levelPath, {allyInfo}, {wave->enemy.creatures});
+        int numWins = battleTest(numTries, levelPath, contentFactory, {allyInfo}, {wave->enemy.creatures});
         totalWins += numWins;
       }
       std::cerr << totalWins << " wins\n";
@@ -1192,64 +1480,139 @@ void MainLoop::endlessTest(int numTries, const FilePath& levelPath, const FilePa
     }
 }
 
-int MainLoop::battleTest(int numTries, const FilePath& levelPath, vector<CreatureList> ally, vector<CreatureList> enemies) {
-  ProgressMeter meter(1);
-  int numAllies = 0;
-  int numEnemies = 0;
-  int numUnknown = 0;
+void MainLoop::setHeadlessBattles(int numThreads, int seed, const FilePath& reportPath) {
+  headlessBattles = HeadlessBattles{numThreads, seed, reportPath, 0, 0};
+  ofstream(reportPath.getPath()) << "battle,run,seed,result,turns,duration_ms\n";
+}
+
+int MainLoop::battleTest(int numTries, const FilePath& levelPath, const ContentFactory& content,
+    vector<CreatureList> ally, vector<CreatureList> enemies) {
   auto allyTribe = TribeId::getDarkKeeper();
-  for (int i : Range(numTries)) {
-    auto contentFactory = createContentFactory(false);
-    EnemyFactory enemyFactory(Random, contentFactory.getCreatures().getNameGenerator(),
+  // Every try gets its own copy of the content, cloned from a serialized snapshot instead of parsing game_config again.
+  string serializedContent;
+  {
+    std::ostringstream output;
+    OutputArchive archive(output);
+    archive(content);
+    serializedContent = output.str();
+  }
+  auto createGame = [&] (RandomGen& random, ProgressMeter& meter, View* view) {
+    ContentFactory contentFactory;
+    {
+      std::istringstream input(serializedContent);
+      InputArchive archive(input);
+      archive(contentFactory);
+    }
+    EnemyFactory enemyFactory(random, contentFactory.getCreatures().getNameGenerator(),
         contentFactory.enemies, contentFactory.buildingInfo, {});
     vector<PCreature> allyCopy;
     for (auto& elem : ally)
-      allyCopy.append(elem.generate(Random, &contentFactory.getCreatures(), TribeId::getDarkKeeper(), MonsterAIFactory::monster()));
-    auto model = ModelBuilder(&meter, Random, options, sokobanInput,
+      allyCopy.append(elem.generate(random, &contentFactory.getCreatures(), allyTribe, MonsterAIFactory::monster()));
+    auto model = ModelBuilder(&meter, random, options, sokobanInput,
         &contentFactory, std::move(enemyFactory)).battleModel(levelPath, std::move(allyCopy), enemies);
-    auto game = Game::splashScreen(std::move(model), CampaignBuilder::getEmptyCampaign(), std::move(contentFactory), view);
-    auto exitCondition = [&](Game* game) -> optional<ExitCondition> {
-      HashSet<TribeId> tribes;
-      for (auto& m : game->getAllModels())
-        for (auto c : m->getAllCreatures())
-          tribes.insert(c->getTribeId());
-      if (tribes.size() == 1) {
-        if (*tribes.begin() == allyTribe)
-          return ExitCondition::ALLIES_WON;
-        else
-          return ExitCondition::ENEMIES_WON;
-      }
-      if (game->getGlobalTime().getVisibleInt() > 200)
-        return ExitCondition::TIMEOUT;
-      if (tribes.empty())
-        return ExitCondition::UNKNOWN;
+    return Game::splashScreen(std::move(model), CampaignBuilder::getEmptyCampaign(), std::move(contentFactory), view);
+  };
+  auto exitCondition = [&](Game* game) -> optional<ExitCondition> {
+    HashSet<TribeId> tribes;
+    for (auto& m : game->getAllModels())
+      for (auto c : m->getAllCreatures())
+        tribes.insert(c->getTribeId());
+    if (tribes.size() == 1) {
+      if (*tribes.begin() == allyTribe)
+        return ExitCondition::ALLIES_WON;
       else
-        return none;
-    };
-    auto result = playGame(std::move(game), false, true, exitCondition, milliseconds{3});
-    switch (result) {
+        return ExitCondition::ENEMIES_WON;
+    }
+    if (game->getGlobalTime().getVisibleInt() > 200)
+      return ExitCondition::TIMEOUT;
+    if (tribes.empty())
+      return ExitCondition::UNKNOWN;
+    else
+      return none;
+  };
+  struct BattleRun {
+    ExitCondition result;
+    int turns;
+    milliseconds duration;
+  };
+  vector<BattleRun> runs(numTries, BattleRun{ExitCondition::UNKNOWN, 0, milliseconds(0)});
+  if (headlessBattles) {
+    int firstSeed = headlessBattles->seed + headlessBattles->numRuns;
+    ConcurrentContentIds concurrentIds;
+    runParallel(numTries, [&] (int index) {
+      auto begin = steady_clock::now();
+      Random.init(firstSeed + index);
+      ProgressMeter meter(1);
+      Clock clock;
+      DummyView view(&clock);
+      auto unlocks = Unlocks::allUnlocked();
+      auto game = createGame(Random, meter, &view);
+      Encyclopedia encyclopedia(game->getContentFactory());
+      game->initialize(options, highscores, &view, fileSharing, &encyclopedia, &unlocks, nullptr);
+      game->initializeModels(meter);
+      auto& run = runs[index];
+      while (true) {
+        if (game->update(1, milliseconds::max()))
+          break;
+        if (auto c = exitCondition(game.get())) {
+          run.result = *c;
+          break;
+        }
+      }
+      run.turns = game->getGlobalTime().getVisibleInt();
+      run.duration = duration_cast<milliseconds>(steady_clock::now() - begin);
+    }, headlessBattles->numThreads);
+  } else
+    for (int i : Range(numTries)) {
+      auto begin = steady_clock::now();
+      ProgressMeter meter(1);
+      auto game = createGame(Random, meter, view);
+      auto& run = runs[i];
+      run.result = playGame(std::move(game), false, true, exitCondition, milliseconds{3});
+      run.duration = duration_cast<milliseconds>(steady_clock::now() - begin);
+    }
+  int numAllies = 0;
+  int numEnemies = 0;
+  int numUnknown = 0;
+  optional<ofstream> report;
+  if (headlessBattles)
+    report.emplace(headlessBattles->reportPath.getPath(), std::ios::app);
+  for (int i : All(runs)) {
+    string result;
+    switch (runs[i].result) {
       case ExitCondition::ALLIES_WON:
         ++numAllies;
         std::cerr << "a";
+        result = "allies_won";
         break;
       case ExitCondition::ENEMIES_WON:
         ++numEnemies;
         std::cerr << "e";
+        result = "enemies_won";
         break;
       case ExitCondition::TIMEOUT:
         ++numUnknown;
         std::cerr << "t";
+        result = "timeout";
         break;
       case ExitCondition::UNKNOWN:
         ++numUnknown;
         std::cerr << "u";
+        result = "unknown";
         break;
     }
-    std::cerr.flush();
+    if (report)
+      *report << headlessBattles->numBattles << "," << headlessBattles->numRuns + i << ","
+          << headlessBattles->seed + headlessBattles->numRuns + i << "," << result << "," << runs[i].turns << ","
+          << runs[i].duration.count() << "\n";
   }
   std::cerr << " " << numAllies << ":" << numEnemies;
   if (numUnknown > 0)
     std::cerr << " (" << numUnknown << ") unknown";
+  if (headlessBattles) {
+    ++headlessBattles->numBattles;
+    headlessBattles->numRuns += numTries;
+  }
   std::cerr << "\n";
   return numAllies;
 }
@@ -1275,14 +1638,6 @@ vector<ExternalEnemy> getExternalEnemiesFor(const AvatarInfo& info, const Conten
 
 ModelTable MainLoop::prepareCampaignModels(CampaignSetup& setup, const AvatarInfo& avatarInfo, RandomGen& random,
     ContentFactory* contentFactory) {
-  EnemyFactory enemyFactory(Random, contentFactory->getCreatures().getNameGenerator(), contentFactory->enemies,
-      contentFactory->buildingInfo, getExternalEnemiesFor(avatarInfo, contentFactory));
-  ModelBuilder modelBuilder(nullptr, random, options, sokobanInput, contentFactory, std::move(enemyFactory));
-  return prepareCampaignModels(setup, avatarInfo, std::move(modelBuilder), contentFactory);
-}
-
-ModelTable MainLoop::prepareCampaignModels(CampaignSetup& setup, const AvatarInfo& avatarInfo,
-    ModelBuilder modelBuilder, ContentFactory* contentFactory) {
   Table<PModel> models(setup.campaign.getSites().getBounds());
   auto& sites = setup.campaign.getSites();
   for (Vec2 v : sites.getBounds())
@@ -1296,32 +1651,39 @@ ModelTable MainLoop::prepareCampaignModels(CampaignSetup& setup, const AvatarInf
   int numRetiredVillains = 0;
   doWithSplash(TStringId("GENERATING_MAP"), numSites,
       [&] (ProgressMeter& meter) {
+        // Retired sites are loaded first, one at a time, because deserialization relies on global state.
+        vector<Vec2> toGenerate;
+        auto retiredIndex = getRetiredSiteIndex();
+        auto retiredVillains = retiredIndex.getEntries().filter([&](const RetiredSiteIndex::Entry& entry) {
+          return isCompatible(entry.version) && entry.version >= 8101 && !!entry.info.retiredEnemyInfo;
+        });
         for (Vec2 v : sites.getBounds()) {
-          if (!sites[v].isEmpty())
-            meter.addProgress();
           int difficulty = setup.campaign.getBaseLevelIncrease(v);
-          if (auto info = sites[v].getKeeper()) {
-            models[v] = getBaseModel(modelBuilder, setup, avatarInfo);
-          } else if (auto villain = sites[v].getVillain()) {
-            for (auto& info : getSaveFiles(userPath, getSaveSuffix(GameSaveType::RETIRED_SITE))) {
-              auto version = getSaveVersion(info);
-              if (isCompatible(version) && version >= 8101)
-                if (auto saved = loadSavedGameInfo(userPath.file(info.filename)))
-                  if (auto& retiredInfo = saved->retiredEnemyInfo)
-                    if (retiredInfo->enemyId == villain->enemyId)
-                      if (auto model = loadRetiredModelFromFile(userPath.file(info.filename))) {
-                        models[v] = PModel(std::move(model->model));
-                        ++numRetiredVillains;
-                        remove(userPath.file(info.filename).getPath());
-                        break;
-                      }
+          if (sites[v].getKeeper())
+            toGenerate.push_back(v);
+          else if (auto villain = sites[v].getVillain()) {
+            optional<int> loadedIndex;
+            for (int i : All(retiredVillains))
+              if (retiredVillains[i].info.retiredEnemyInfo->enemyId == villain->enemyId)
+                if (auto model = loadRetiredModelFromFile(userPath.file(retiredVillains[i].filename))) {
+                  models[v] = PModel(std::move(model->model));
+                  ++numRetiredVillains;
+                  loadedIndex = i;
+                  break;
+                }
+            if (loadedIndex) {
+              auto file = userPath.file(retiredVillains.removeIndexPreserveOrder(*loadedIndex).filename);
+              retiredIndex.remove(file);
+              remove(file.getPath());
             }
-            if (!models[v])
-              models[v] = modelBuilder.campaignSiteModel(villain->enemyId, villain->type, avatarInfo.tribeAlignment,
-                  *setup.campaign.getSites()[v].biome, difficulty);
-            for (auto c : models[v]->getAllCreatures())
-              c->setCombatExperience(difficulty);
+            if (models[v]) {
+              for (auto c : models[v]->getAllCreatures())
+                c->setCombatExperience(difficulty);
+              meter.addProgress();
+            } else
+              toGenerate.push_back(v);
           } else if (auto retired = sites[v].getRetired()) {
+            meter.addProgress();
             if (auto info = loadRetiredModelFromFile(userPath.file(retired->fileInfo.filename))) {
               models[v] = PModel(std::move(info->model));
               for (auto col : models[v]->getCollectives())
@@ -1337,6 +1699,41 @@ ModelTable MainLoop::prepareCampaignModels(CampaignSetup& setup, const AvatarInf
             }
           }
         }
+        // The remaining sites are generated in parallel. Each one gets its own generator seeded in site order,
+        // so the campaign comes out the same regardless of the number of threads.
+        vector<int> seeds = toGenerate.transform([&](Vec2) { return int(random.getLL()); });
+        int continuationSeed = int(random.getLL());
+        auto nameGenerator = contentFactory->getCreatures().getNameGenerator();
+        // Every site draws names from its own slice of the lists. The drawn names are moved to the back
+        // of the shared lists afterwards, in site order, so that they aren't reused soon.
+        vector<NameGenerator::LocalNames::Used> usedNames(toGenerate.size());
+        ConcurrentContentIds concurrentIds;
+        runParallel(toGenerate.size(), [&] (int index) {
+          Vec2 v = toGenerate[index];
+          RandomGen siteRandom;
+          siteRandom.init(seeds[index]);
+          Random.init(int(siteRandom.getLL()));
+          NameGenerator::LocalNames localNames(*nameGenerator, index, toGenerate.size());
+          EnemyFactory enemyFactory(siteRandom, nameGenerator, contentFactory->enemies,
+              contentFactory->buildingInfo, getExternalEnemiesFor(avatarInfo, contentFactory));
+          ModelBuilder modelBuilder(nullptr, siteRandom, options, sokobanInput, contentFactory,
+              std::move(enemyFactory));
+          if (sites[v].getKeeper())
+            models[v] = getBaseModel(modelBuilder, setup, avatarInfo);
+          else {
+            auto villain = sites[v].getVillain();
+            int difficulty = setup.campaign.getBaseLevelIncrease(v);
+            models[v] = modelBuilder.campaignSiteModel(villain->enemyId, villain->type, avatarInfo.tribeAlignment,
+                *sites[v].biome, difficulty);
+            for (auto c : models[v]->getAllCreatures())
+              c->setCombatExperience(difficulty);
+          }
+          usedNames[index] = localNames.getUsed();
+          meter.addProgress();
+        });
+        for (auto& used : usedNames)
+          nameGenerator->markUsed(used);
+        Random.init(continuationSeed);
       });
   if (failedToLoad)
     view->presentText(none, TString("Error reading " + *failedToLoad + ". Leaving blank site."));
@@ -26,6 +26,7 @@ class NameGenerator;
 struct ModelTable;
 class TileSet;
 class ContentFactory;
+class RetiredSiteIndex;
 class TilePaths;
 struct ModVersionInfo;
 struct ModDetails;
@@ -45,11 +46,16 @@ class MainLoop {
   void start(bool tilesPresent);
   void modelGenTest(int numTries, const vector<std::string>& types, RandomGen&, Options*);
   void battleTest(int numTries, const FilePath& levelPath, const FilePath& battleInfoPath, string enemyId);
-  int battleTest(int numTries, const FilePath& levelPath, vector<CreatureList> ally, vector<CreatureList> enemies);
+  int battleTest(int numTries, const FilePath& levelPath, const ContentFactory&, vector<CreatureList> ally,
+      vector<CreatureList> enemies);
+  void setHeadlessBattles(int numThreads, int seed, const FilePath& reportPath);
   void endlessTest(int numTries, const FilePath& levelPath, const FilePath& battleInfoPath, optional<int> numEnemy);
   void campaignBattleText(int numTries, const FilePath& levelPath, EnemyId keeperId, VillainGroup);
   int campaignBattleText(int numTries, const FilePath& levelPath, EnemyId keeperId, EnemyId);
   void launchQuickGame(optional<int> maxTurns, optional<string> keeperName);
+  void benchSim(const string& saveOrKeeper, int numTurns, int seed, const FilePath& reportPath);
+  void benchPaths(const string& saveOrKeeper, int numPaths, int seed);
+  void benchSave(const string& saveOrKeeper, int numTries);
   void genZLevels(const string& keeperType);
   ContentFactory createContentFactory(bool vanillaOnly) const;
 
@@ -67,6 +73,8 @@ class MainLoop {
   void doWithSplash(const TString& text, function<void()> fun, function<void()> cancelFun = nullptr);
 
   PGame prepareCampaign(RandomGen&);
+  PGame prepareQuickGame(ContentFactory, const string& keeperName);
+  PGame prepareBenchGame(const string& saveOrKeeper, int seed);
   PGame prepareWarlord(const SaveFileInfo&);
   enum class ExitCondition;
   ExitCondition playGame(PGame, bool withMusic, bool noAutoSave, function<optional<ExitCondition> (Game*)> = nullptr,
@@ -76,7 +84,6 @@ class MainLoop {
   void showMods();
   void playMenuMusic();
   ModelTable prepareCampaignModels(CampaignSetup& campaign, const AvatarInfo&, RandomGen&, ContentFactory*);
-  ModelTable prepareCampaignModels(CampaignSetup& campaign, const AvatarInfo&, ModelBuilder, ContentFactory*);
   PGame loadGame(const FilePath&, const TString& name);
   PGame loadOrNewGame();
   FilePath getSavePath(const PGame&, GameSaveType);
@@ -107,7 +114,11 @@ class MainLoop {
   PGame prepareTutorial(const ContentFactory*);
   void bugReportSave(PGame&, FilePath);
   void saveGame(PGame&, const FilePath&);
+  void saveGameInBackground(PGame&, const FilePath&);
+  void waitForBackgroundSave();
+  thread backgroundSave;
   void saveMainModel(PGame&, const FilePath& modelPath);
+  RetiredSiteIndex getRetiredSiteIndex() const;
   TilePaths getTilePathsForAllMods() const;
   vector<string> getCurrentMods() const;
 
@@ -133,5 +144,13 @@ class MainLoop {
   bool useSingleThread();
   Unlocks* unlocks;
   SteamAchievements* steamAchievements = nullptr;
+  struct HeadlessBattles {
+    int numThreads;
+    int seed;
+    FilePath reportPath;
+    int numBattles;
+    int numRuns;
+  };
+  optional<HeadlessBattles> headlessBattles;
   Translations* translations;
 };
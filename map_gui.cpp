@@ -49,7 +49,7 @@ MapGui::MapGui(Callbacks call, SyncQueue<UserInput>& inputQueue, Clock* c, Optio
     unique_ptr<fx::FXRenderer> fxRenderer, unique_ptr<FXViewManager> fxViewManager)
     : objects(Level::getMaxBounds()), callbacks(call), inputQueue(inputQueue),
     clock(c), options(o), fogOfWar(Level::getMaxBounds(), false), extraBorderPos(Level::getMaxBounds(), {}),
-    lastSquareUpdate(Level::getMaxBounds()), connectionMap(Level::getMaxBounds()), guiFactory(f),
+    connectionMap(Level::getMaxBounds()), guiFactory(f),
     fxRenderer(std::move(fxRenderer)), fxViewManager(std::move(fxViewManager)) {
   clearCenter();
 }
@@ -1429,7 +1429,7 @@ bool MapGui::onClick(MouseButtonId b, Vec2 v) {
   }
 }
 
-void MapGui::updateObject(Vec2 pos, CreatureView* view, Renderer& renderer, milliseconds currentTime) {
+void MapGui::updateObject(Vec2 pos, CreatureView* view, Renderer& renderer) {
   auto level = view->getCreatureViewLevel();
   objects[pos].emplace();
   auto& index = *objects[pos];
@@ -1437,7 +1437,6 @@ void MapGui::updateObject(Vec2 pos, CreatureView* view, Renderer& renderer, mill
   level->setNeedsRenderUpdate(pos, false);
   if (index.hasObject(ViewLayer::FLOOR) || index.hasObject(ViewLayer::FLOOR_BACKGROUND))
     index.setNightAmount(1.0 - level->getLight(pos));
-  lastSquareUpdate[pos] = currentTime;
   connectionMap[pos].clear();
   shadowed.erase(pos + Vec2(0, 1));
   if (index.hasObject(ViewLayer::FLOOR)) {
@@ -1542,6 +1541,11 @@ void MapGui::updateObjects(CreatureView* view, Renderer& renderer, MapLayout* ma
   // team members in turn-based mode.
   const bool newView = (view->getCenterType() != previousView);
   const bool newLevel = level != previousLevel;
+  // Squares are only updated when something marks them with Level::setNeedsRenderUpdate. The only
+  // global change that isn't reported this way is the amount of sunlight, which affects the night shading.
+  const double sunlight = level->getGame()->getSunlightInfo().getLightAmount();
+  const bool sunlightChanged = sunlight != lastSunlightAmount;
+  lastSunlightAmount = sunlight;
   if (newView || newLevel) {
     if (auto *inst = fx::FXManager::getInstance())
       inst->clearUnorderedEffects();
@@ -1549,9 +1553,9 @@ void MapGui::updateObjects(CreatureView* view, Renderer& renderer, MapLayout* ma
       level->setNeedsRenderUpdate(pos, true);
   } else
     for (Vec2 pos : mapLayout->getAllTiles(getBounds(), Level::getMaxBounds(), getScreenPos()))
-      if (level->needsRenderUpdate(pos) ||
-          !lastSquareUpdate[pos] || *lastSquareUpdate[pos] < currentTimeReal - milliseconds{1000})
-        updateObject(pos, view, renderer, currentTimeReal);
+      if (level->needsRenderUpdate(pos) || (sunlightChanged && pos.inRectangle(levelBounds) &&
+          level->getLevelGenSunlight(pos) > 0))
+        updateObject(pos, view, renderer);
   previousView = view->getCenterType();
   previousLevel = level;
   keyScrolling = view->getCenterType() == CreatureView::CenterType::NONE;
@@ -100,7 +100,7 @@ class MapGui : public GuiElem {
   bool onRightClick(Vec2);
   bool onMiddleClick(Vec2);
   void onMouseRelease(Vec2);
-  void updateObject(Vec2, CreatureView*, Renderer&, milliseconds currentTime);
+  void updateObject(Vec2, CreatureView*, Renderer&);
   void drawObjectAbs(Renderer&, Vec2 pos, const ViewObject&, Vec2 size, Vec2 movement, Vec2 tilePos,
       milliseconds currentTimeReal, const ViewIndex&);
   void drawCreatureHighlights(Renderer&, const ViewObject&, const ViewIndex&, Vec2 pos, Vec2 sz,
@@ -165,7 +165,7 @@ class MapGui : public GuiElem {
   } mouseOffset, center;
   const Level* previousLevel = nullptr;
   optional<CreatureViewCenterType> previousView;
-  Table<optional<milliseconds>> lastSquareUpdate;
+  double lastSunlightAmount = 0;
   optional<Coords> softCenter;
   Vec2 lastMousePos;
   optional<Vec2> lastMouseMove;
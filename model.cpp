@@ -60,6 +60,7 @@
 #include "warlord_controller.h"
 #include "territory.h"
 #include "portals.h"
+#include "sim_timer.h"
 
 template <class Archive>
 void Model::serialize(Archive& ar, const unsigned int version) {
@@ -141,6 +142,7 @@ bool Model::update(double totalTime) {
 }
 
 void Model::tick(LocalTime time) { PROFILE
+  SIM_TIMER(SimTimerId::MODEL_TICK);
   for (Creature* c : timeQueue->getAllCreatures()) {
     c->tick();
   }
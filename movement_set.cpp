@@ -47,6 +47,19 @@ bool MovementSet::blocksPrisoners() const {
   return blockingPrisoners;
 }
 
+EnumSet<MovementDependency> MovementSet::getDependencies() const {
+  EnumSet<MovementDependency> ret;
+  if (blockingEnemies)
+    ret.insert(MovementDependency::TRIBE);
+  if (blockingPrisoners)
+    ret.insert(MovementDependency::PRISONER);
+  if (blockingFarmAnimals)
+    ret.insert(MovementDependency::FARM_ANIMAL);
+  if (!forcibleTraits.isEmpty())
+    ret.insert(MovementDependency::FORCED);
+  return ret;
+}
+
 MovementSet& MovementSet::addTrait(MovementTrait trait) {
   traits.insert(trait);
   return *this;
@@ -14,6 +14,7 @@ class MovementSet {
 
   bool hasTrait(MovementTrait) const;
   bool blocksPrisoners() const;
+  EnumSet<MovementDependency> getDependencies() const;
 
   MovementSet& addTrait(MovementTrait);
   MovementSet& removeTrait(MovementTrait);
@@ -32,6 +32,25 @@ int MovementType::getHash() const {
       8 * buildBridge + prisoner * 16 + farmAnimal * 32;
 }
 
+MovementType MovementType::getCanonical(EnumSet<MovementDependency> dependencies) const {
+  auto ret = *this;
+  // Bridge building and destroying furniture check the tribe regardless of other dependencies.
+  if (!dependencies.contains(MovementDependency::TRIBE) && !buildBridge && destroyActions.isEmpty())
+    ret.tribeSet = none;
+  if (!dependencies.contains(MovementDependency::SUNLIGHT))
+    ret.sunlightVulnerable = false;
+  if (!dependencies.contains(MovementDependency::FIRE))
+    ret.fireResistant = false;
+  if (!dependencies.contains(MovementDependency::PRISONER))
+    ret.prisoner = false;
+  if (!dependencies.contains(MovementDependency::FARM_ANIMAL))
+    ret.farmAnimal = false;
+  // Forced movement bypasses all of the above restrictions and enables forcible traits.
+  if (dependencies.isEmpty())
+    ret.forced = false;
+  return ret;
+}
+
 bool MovementType::isCompatible(TribeId id) const {
   return !tribeSet || tribeSet->contains(id);
 }
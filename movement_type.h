@@ -11,6 +11,16 @@ RICH_ENUM(MovementTrait,
   WADE
 );
 
+// Conditions under which the corresponding properties of a MovementType affect where it can go.
+RICH_ENUM(MovementDependency,
+  TRIBE,
+  SUNLIGHT,
+  FIRE,
+  PRISONER,
+  FARM_ANIMAL,
+  FORCED
+);
+
 class MovementType {
   public:
   MovementType(EnumSet<MovementTrait> = {});
@@ -28,6 +38,9 @@ class MovementType {
   MovementType& setPrisoner(bool = true);
   MovementType& setFarmAnimal(bool = true);
   const EnumSet<DestroyAction::Type>& getDestroyActions() const;
+  // Returns a type that can go to the same places as this one, given that only the dependencies in the set
+  // occur. Types that map to the same value can share their navigation data.
+  MovementType getCanonical(EnumSet<MovementDependency>) const;
 
   bool isSunlightVulnerable() const;
   bool isFireResistant() const;
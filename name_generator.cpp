@@ -81,7 +81,55 @@ void NameGenerator::merge(NameGenerator g) {
       names.insert(std::move(elem));
 }
 
+static thread_local NameGenerator::LocalNames* localNames = nullptr;
+
+NameGenerator::LocalNames::LocalNames(const NameGenerator& g, int sliceIndex, int numSlices)
+    : generator(&g), sliceIndex(sliceIndex), numSlices(numSlices), previous(localNames) {
+  localNames = this;
+}
+
+NameGenerator::LocalNames::~LocalNames() {
+  localNames = previous;
+}
+
+NameGenerator::LocalNames::Used NameGenerator::LocalNames::getUsed() const {
+  Used ret;
+  for (auto& elem : lists)
+    if (!elem.second.used.empty())
+      ret[elem.first] = elem.second.used;
+  return ret;
+}
+
+void NameGenerator::markUsed(const LocalNames::Used& used) {
+  for (auto& elem : used)
+    if (auto list = getReferenceMaybe(names, elem.first))
+      for (auto& name : elem.second) {
+        auto it = std::find(list->begin(), list->end(), name);
+        if (it != list->end()) {
+          list->erase(it);
+          list->push_back(name);
+        }
+      }
+}
+
 string NameGenerator::getNext(NameGeneratorId id) {
+  if (localNames && localNames->generator == this) {
+    auto& local = localNames->lists[id];
+    if (local.names.empty()) {
+      auto orig = getReferenceMaybe(names, id);
+      CHECK(orig && !orig->empty());
+      // A site that needs more names than its slice continues into the following ones.
+      int begin = orig->size() * localNames->sliceIndex / localNames->numSlices;
+      local.names = *orig;
+      std::rotate(local.names.begin(), local.names.begin() + begin, local.names.end());
+    }
+    string ret = local.names.front();
+    local.names.pop_front();
+    local.names.push_back(ret);
+    if (local.used.size() < local.names.size())
+      local.used.push_back(ret);
+    return ret;
+  }
   CHECK(!names[id].empty());
   string ret = names[id].front();
   names[id].pop_front();
@@ -32,6 +32,31 @@ class NameGenerator {
   template <typename Archive>
   void serialize(Archive&, unsigned);
 
+  // While alive, getNext() on the current thread draws from a private copy of every name list, starting
+  // at the given slice of it, so that concurrently generated sites get different names. The names that were
+  // drawn can be moved to the back of the shared lists afterwards with markUsed().
+  class LocalNames {
+    public:
+    LocalNames(const NameGenerator&, int sliceIndex, int numSlices);
+    ~LocalNames();
+    LocalNames(const LocalNames&) = delete;
+    using Used = map<NameGeneratorId, vector<string>>;
+    Used getUsed() const;
+
+    private:
+    friend class NameGenerator;
+    const NameGenerator* generator;
+    int sliceIndex;
+    int numSlices;
+    struct List {
+      deque<string> names;
+      vector<string> used;
+    };
+    map<NameGeneratorId, List> lists;
+    LocalNames* previous;
+  };
+  void markUsed(const LocalNames::Used&);
+
   private:
   map<NameGeneratorId, deque<string>> SERIAL(names);
 };
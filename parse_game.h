@@ -6,9 +6,11 @@
 #include "file_path.h"
 #include "pretty_archive.h"
 #include "t_string.h"
+#include "compressed_stream.h"
 
 typedef StreamCombiner<ogzstream, OutputArchive> CompressedOutput;
-typedef StreamCombiner<igzstream, InputArchive> CompressedInput;
+typedef StreamCombiner<CompressedInputStream, InputArchive> CompressedInput;
+typedef StreamCombiner<ChunkedOutputStream, OutputArchive> ChunkedCompressedOutput;
 
 template <typename InputType>
 optional<pair<TString, int>> getNameAndVersionUsing(const FilePath& filename) {
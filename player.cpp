@@ -1364,18 +1364,21 @@ optional<Vec2> Player::getPlayerPosition() const  {
 }
 
 vector<vector<Vec2>> Player::getPermanentPaths() const {
-  vector<vector<Vec2>> ret;
+  vector<LevelShortestPath::Request> requests;
   for (auto c : getTeam())
     if (auto task = c->getController()->getDragTask())
       if (auto target = task->getPosition())
-        if (target->isSameLevel(creature->getPosition()) && target->isSameLevel(c->getPosition())) {
-          auto res = LevelShortestPath(c, *target, 0).getPath()
-              .filter([&, level = getLevel()](auto& pos) { return pos.getLevel() == level; } )
-              .transform([&](auto& pos) { return pos.getCoord(); } );
-          if (res.size() > 1)
-            res.pop_back();
-          ret.push_back(std::move(res));
-        }
+        if (target->isSameLevel(creature->getPosition()) && target->isSameLevel(c->getPosition()))
+          requests.push_back({c->getPosition(), c->getMovementType(), *target, 0, c->getUniqueId()});
+  vector<vector<Vec2>> ret;
+  for (auto& path : LevelShortestPath::computeAll(requests)) {
+    auto res = path.getPath()
+        .filter([&, level = getLevel()](auto& pos) { return pos.getLevel() == level; } )
+        .transform([&](auto& pos) { return pos.getCoord(); } );
+    if (res.size() > 1)
+      res.pop_back();
+    ret.push_back(std::move(res));
+  }
   return ret;
 }
 
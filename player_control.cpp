@@ -2008,28 +2008,60 @@ void PlayerControl::refreshGameInfo(GameInfo& gameInfo) const {
   fillCurrentLevelInfo(gameInfo);
   if (tutorial)
     tutorial->refreshInfo(getGame(), gameInfo.tutorial);
-  gameInfo.villageInfo.villages.clear();
-  gameInfo.villageInfo.numMainVillains = gameInfo.villageInfo.numConqueredMainVillains = 0;
-  for (auto& col : getGame()->getVillains(VillainType::MAIN)) {
-    ++gameInfo.villageInfo.numMainVillains;
-    if (col->isConquered())
-      ++gameInfo.villageInfo.numConqueredMainVillains;
-  }
-  for (auto& col : getKnownVillains())
-    if (col->getName() && col->isDiscoverable())
-      gameInfo.villageInfo.villages.push_back(getVillageInfo(col));
+  auto& cache = gameInfoCache;
+  if (cache.time != getGame()->getGlobalTime()) {
+    cache.time = getGame()->getGlobalTime();
+    cache.dirty = EnumSet<GameInfoSection>::fullSet();
+  }
+  if (cache.dirty.contains(GameInfoSection::VILLAGES)) {
+    auto& villageInfo = cache.villageInfo;
+    villageInfo.villages.clear();
+    villageInfo.numMainVillains = villageInfo.numConqueredMainVillains = 0;
+    for (auto& col : getGame()->getVillains(VillainType::MAIN)) {
+      ++villageInfo.numMainVillains;
+      if (col->isConquered())
+        ++villageInfo.numConqueredMainVillains;
+    }
+    for (auto& col : getKnownVillains())
+      if (col->getName() && col->isDiscoverable())
+        villageInfo.villages.push_back(getVillageInfo(col));
+    std::stable_sort(villageInfo.villages.begin(), villageInfo.villages.end(),
+         [](const auto& v1, const auto& v2) { return (int) v1.type < (int) v2.type; });
+  }
+  gameInfo.villageInfo = cache.villageInfo;
   gameInfo.villageInfo.dismissedInfos = dismissedVillageInfos;
-  std::stable_sort(gameInfo.villageInfo.villages.begin(), gameInfo.villageInfo.villages.end(),
-       [](const auto& v1, const auto& v2) { return (int) v1.type < (int) v2.type; });
   SunlightInfo sunlightInfo = getGame()->getSunlightInfo();
   gameInfo.sunlightInfo = { sunlightInfo.getText(), sunlightInfo.getTimeRemaining() };
   gameInfo.infoType = GameInfo::InfoType::BAND;
   gameInfo.playerInfo = CollectiveInfo();
   auto& info = *gameInfo.playerInfo.getReferenceMaybe<CollectiveInfo>();
-  info.buildings = fillButtons();
-  fillMinions(info);
-  fillImmigration(info);
-  fillImmigrationHelp(info);
+  auto& cachedInfo = cache.collectiveInfo;
+  if (cache.dirty.contains(GameInfoSection::BUILDINGS))
+    cachedInfo.buildings = fillButtons();
+  info.buildings = cachedInfo.buildings;
+  if (cache.dirty.contains(GameInfoSection::MINIONS)) {
+    fillMinions(cachedInfo);
+    cachedInfo.minionPromotions.clear();
+    cachedInfo.availablePromotions = 0;
+    for (auto c : collective->getCreatures())
+      if (c->getAttributes().promotionGroup)
+        fillPromotions(c, cachedInfo);
+  }
+  info.minionGroups = cachedInfo.minionGroups;
+  info.automatonGroups = cachedInfo.automatonGroups;
+  info.minions = cachedInfo.minions;
+  info.minionCount = cachedInfo.minionCount;
+  info.minionLimit = cachedInfo.minionLimit;
+  info.populationString = cachedInfo.populationString;
+  info.minionPromotions = cachedInfo.minionPromotions;
+  info.availablePromotions = cachedInfo.availablePromotions;
+  if (cache.dirty.contains(GameInfoSection::IMMIGRATION)) {
+    fillImmigration(cachedInfo);
+    fillImmigrationHelp(cachedInfo);
+  }
+  info.immigration = cachedInfo.immigration;
+  info.allImmigration = cachedInfo.allImmigration;
+  cache.dirty.clear();
   info.chosenCreature.reset();
   if (chosenCreature)
     if (Creature* c = getCreature(chosenCreature->id)) {
@@ -2042,11 +2074,6 @@ void PlayerControl::refreshGameInfo(GameInfo& gameInfo) const {
     }
   fillWorkshopInfo(info);
   fillLibraryInfo(info);
-  info.minionPromotions.clear();
-  info.availablePromotions = 0;
-  for (auto c : collective->getCreatures())
-    if (c->getAttributes().promotionGroup)
-      fillPromotions(c, info);
   fillDungeonLevel(info.avatarLevelInfo);
   fillResources(info);
   gameInfo.time = collective->getGame()->getGlobalTime();
@@ -2127,8 +2154,33 @@ void PlayerControl::addWindowMessage(ViewIdList viewId, const TString& message)
   getView()->windowedMessage(viewId, message);
 }
 
+static EnumSet<GameInfoSection> getAffectedInfoSections(const GameEvent& event) {
+  using namespace EventInfo;
+  using Sections = EnumSet<GameInfoSection>;
+  return event.visit<Sections>(
+      [](const CreatureKilled&) { return Sections{GameInfoSection::MINIONS, GameInfoSection::IMMIGRATION}; },
+      [](const CreatureStunned&) { return Sections{GameInfoSection::MINIONS, GameInfoSection::IMMIGRATION}; },
+      [](const CreatureTortured&) { return Sections{GameInfoSection::MINIONS}; },
+      [](const CreatureAttacked&) { return Sections{GameInfoSection::MINIONS}; },
+      [](const LeaderWounded&) { return Sections{GameInfoSection::MINIONS}; },
+      [](const ItemsOwned&) { return Sections{GameInfoSection::MINIONS}; },
+      [](const ItemsPickedUp&) { return Sections{GameInfoSection::BUILDINGS}; },
+      [](const ItemsDropped&) { return Sections{GameInfoSection::BUILDINGS}; },
+      [](const ItemsAppeared&) { return Sections{GameInfoSection::BUILDINGS}; },
+      [](const ItemsPillaged&) { return Sections{GameInfoSection::BUILDINGS}; },
+      [](const ItemStolen&) { return Sections{GameInfoSection::BUILDINGS}; },
+      [](const FurnitureRemoved&) { return Sections{GameInfoSection::BUILDINGS}; },
+      [](const TechbookRead&) { return Sections{GameInfoSection::BUILDINGS, GameInfoSection::IMMIGRATION}; },
+      [](const ConqueredEnemy&) { return Sections::fullSet(); },
+      [](const WonGame&) { return Sections::fullSet(); },
+      [](const RetiredGame&) { return Sections::fullSet(); },
+      [](const auto&) { return Sections(); }
+  );
+}
+
 void PlayerControl::onEvent(const GameEvent& event) {
   using namespace EventInfo;
+  gameInfoCache.dirty.sumWith(getAffectedInfoSections(event));
   event.visit<void>(
       [&](const Projectile& info) {
         if (getControlled().empty() && (canSee(info.begin) || canSee(info.end)) && info.begin.isSameLevel(getCurrentLevel())) {
@@ -2263,10 +2315,36 @@ void PlayerControl::onEvent(const GameEvent& event) {
       [&](const LeaderWounded& info) {
         leaderWoundedTime.set(info.c, getModel()->getLocalTime());
       },
+      [&](const MovementChanged& info) {
+        // A door or wall anywhere may open or close off a prison or an animal pen.
+        if (info.pos.getModel() == getModel())
+          updateEnclosureHighlights();
+      },
       [&](const auto&) {}
   );
 }
 
+// Positions of tasks and activities show whether the dragged creature can be dropped there.
+void PlayerControl::updateDragHighlights() {
+  for (auto task : collective->getTaskMap().getAllTasks())
+    if (auto pos = collective->getTaskMap().getPosition(task))
+      pos->setNeedsRenderUpdate(true);
+  for (auto task : ENUM_ALL(MinionActivity))
+    for (auto& pos : collective->getMinionActivities().getAllPositions(collective, nullptr, task))
+      pos.first.setNeedsRenderUpdate(true);
+}
+
+void PlayerControl::updateEnclosureHighlights() {
+  auto& constructions = collective->getConstructions();
+  for (auto pos : constructions.getBuiltPositions(FurnitureType("PRISON")))
+    pos.setNeedsRenderUpdate(true);
+  auto& factory = getGame()->getContentFactory()->furniture;
+  for (auto type : factory.getFurnitureThatIncreasePopulation())
+    if (factory.getData(type).getPopulationIncrease().requiresAnimalFence)
+      for (auto pos : constructions.getBuiltPositions(type))
+        pos.setNeedsRenderUpdate(true);
+}
+
 void PlayerControl::updateKnownLocations(const Position& pos) {
   PROFILE;
   /*if (pos.getModel() == getModel())
@@ -2662,6 +2740,7 @@ void PlayerControl::handleBanishing(Creature* c) {
 }
 
 void PlayerControl::processInput(View* view, UserInput input) {
+  gameInfoCache.dirty = EnumSet<GameInfoSection>::fullSet();
   switch (input.getId()) {
     case UserInputId::MESSAGE_INFO:
       if (auto message = findMessage(input.get<PlayerMessage::Id>())) {
@@ -2696,23 +2775,20 @@ void PlayerControl::processInput(View* view, UserInput input) {
     }
     case UserInputId::CREATURE_DRAG:
       draggedCreature = input.get<Creature::Id>();
-      for (auto task : collective->getTaskMap().getAllTasks())
-        if (auto pos = collective->getTaskMap().getPosition(task))
-          pos->setNeedsRenderUpdate(true);
-      for (auto task : ENUM_ALL(MinionActivity))
-        for (auto& pos : collective->getMinionActivities().getAllPositions(collective, nullptr, task))
-          pos.first.setNeedsRenderUpdate(true);
+      updateDragHighlights();
       break;
     case UserInputId::CREATURE_DRAG_DROP: {
       auto info = input.get<CreatureDropInfo>();
       minionDragAndDrop(info.pos, info.creatureId);
       draggedCreature = none;
+      updateDragHighlights();
       break;
     }
     case UserInputId::CREATURE_GROUP_DRAG_ON_MAP: {
       auto info = input.get<CreatureGroupDropInfo>();
       minionDragAndDrop(info.pos, info.group);
       draggedCreature = none;
+      updateDragHighlights();
       break;
     }
     case UserInputId::TEAM_DRAG_DROP: {
@@ -3827,6 +3903,12 @@ void PlayerControl::considerSoloAchievement() {
 
 void PlayerControl::tick() {
   prisonSizeCache.clear();
+  bool populationFull = collective->getMaxPopulation() <= collective->getPopulationSize();
+  if (populationFull != wasPopulationFull) {
+    wasPopulationFull = populationFull;
+    for (auto pos : collective->getConstructions().getBuiltPositions(FurnitureType("TORTURE_TABLE")))
+      pos.setNeedsRenderUpdate(true);
+  }
   collective->getConstructions().checkDebtConsistency();
   PROFILE_BLOCK("PlayerControl::tick");
   for (auto c : collective->getCreatures()) {
@@ -27,6 +27,8 @@
 #include "resource_id.h"
 #include "bed_type.h"
 
+RICH_ENUM(GameInfoSection, BUILDINGS, MINIONS, IMMIGRATION, VILLAGES);
+
 class Model;
 class Technology;
 class View;
@@ -196,6 +198,15 @@ class PlayerControl : public CreatureView, public CollectiveControl, public Even
   void minionAIAction(const AIActionInfo&);
   void minionDragAndDrop(Vec2 pos, variant<TString, UniqueEntity<Creature>::Id>);
   void fillMinions(CollectiveInfo&) const;
+  // Parts of the GameInfo that are expensive to build are only refreshed when the game time advances,
+  // on player input or on game events that can affect them.
+  struct GameInfoCache {
+    EnumSet<GameInfoSection> dirty = EnumSet<GameInfoSection>::fullSet();
+    optional<GlobalTime> time;
+    VillageInfo villageInfo;
+    CollectiveInfo collectiveInfo;
+  };
+  mutable GameInfoCache gameInfoCache;
   vector<Creature*> getMinionGroup(const TString& groupName) const;
   vector<PlayerInfo> getPlayerInfos(vector<Creature*>) const;
   void sortMinionsForUI(vector<Creature*>&) const;
@@ -308,4 +319,7 @@ class PlayerControl : public CreatureView, public CollectiveControl, public Even
   void considerSoloAchievement();
   bool SERIAL(soloKeeper) = true;
   mutable EnumMap<BedType, optional<int>> prisonSizeCache;
+  void updateEnclosureHighlights();
+  void updateDragHighlights();
+  bool wasPopulationFull = false;
 };
@@ -251,6 +251,7 @@ void Position::registerPortal() {
       if (isSameLevel(*other)) {
         for (auto& sectors : level->sectors)
           sectors.second.addExtraConnection(coord, other->coord);
+        level->flowFields->clear();
       } else {
         auto key = StairKey::getNew();
         setLandingLink(key);
@@ -268,6 +269,7 @@ void Position::removePortal() {
       if (isSameLevel(*other)) {
         for (auto& sectors : level->sectors)
           sectors.second.removeExtraConnection(coord, other->coord);
+        level->flowFields->clear();
       } else {
         removeLandingLink();
         other->removeLandingLink();
@@ -449,7 +451,13 @@ TString Position::getName() const {
 void Position::getViewIndex(ViewIndex& index, const Creature* viewer) const {
   PROFILE;
   if (isValid()) {
-    getSquare()->getViewIndex(getGame()->getContentFactory(), index, viewer);
+    auto factory = getGame()->getContentFactory();
+    getSquare()->getViewIndex(factory, index, viewer);
+    for (auto& type : factory->tileGasTypes) {
+      auto amount = level->tileGas->getAmount(coord, type.first);
+      if (amount > 0)
+        index.addGasAmount(type.second.name, type.second.color.transparency(amount * 255));
+    }
     if (isUnavailable())
       index.setHighlight(HighlightType::UNAVAILABLE);
     if (isCovered())
@@ -559,7 +567,7 @@ bool Position::canEnterEmptyCalc(const MovementType& t, optional<FurnitureLayer>
     return false;
   const auto square = getSquare();
   bool result = true;
-  const bool covered = isCovered() || getSquare()->hasSunlightBlockingGasAmount();
+  const bool covered = isCovered() || level->tileGas->hasSunlightBlockingAmount(coord);
   for (auto layer : ENUM_ALL(FurnitureLayer))
     if (layer != ignore)
       if (auto furniture = level->furniture->getBuilt(layer).getReadonly(coord)) {
@@ -629,11 +637,19 @@ void Position::addFurnitureImpl(PFurniture f) const {
     level->addLightSource(coord, furniture->getLightEmission());
     updateSupportViewId(furniture);
     setNeedsRenderAndMemoryUpdate(true);
+    if (furniture->getLuxury() > 0)
+      updateLuxuryNeighbors();
     if (auto& effect = furniture->getLastingEffectInfo())
       addFurnitureEffect(furniture->getTribe(), *effect);
   }
 }
 
+// Efficiency of neighboring furniture depends on luxury and is shown on the map.
+void Position::updateLuxuryNeighbors() const {
+  for (auto v : neighbors8())
+    v.setNeedsRenderUpdate(true);
+}
+
 template <typename Fun1, typename Fun2>
 void handleEffect(TribeId tribe, Level::EffectsTable& effectsTable, vector<Position> positions,
     const FurnitureEffectInfo& effect, Fun1 fun1, Fun2 fun2) {
@@ -759,6 +775,7 @@ void Position::removeFurniture(const Furniture* f, PFurniture replace, Creature*
   auto replacePtr = replace.get();
   auto layer = f->getLayer();
   auto type = f->getType();
+  bool luxuryChanged = f->getLuxury() > 0 || (replacePtr && replacePtr->getLuxury() > 0);
   CHECK(layer != FurnitureLayer::GROUND || !!replace);
   CHECK(!!getFurniture(layer)) << "null furniture " << type.data() << " " << EnumInfo<FurnitureLayer>::getString(layer);
   CHECK(getFurniture(layer) == f) << getFurniture(layer)->getType().data() << " " << type.data() << " " << EnumInfo<FurnitureLayer>::getString(layer);
@@ -784,6 +801,8 @@ void Position::removeFurniture(const Furniture* f, PFurniture replace, Creature*
       replacePtr->onEnter(c);
   }
   setNeedsRenderAndMemoryUpdate(true);
+  if (luxuryChanged)
+    updateLuxuryNeighbors();
   getGame()->addEvent(EventInfo::FurnitureRemoved{*this, type, layer, destroyedBy});
 }
 
@@ -983,14 +1002,16 @@ vector<Position> Position::getVisibleTiles(const Vision& vision) {
 
 void Position::addGas(TileGasType type, double amount) {
   PROFILE;
-  if (isValid())
-    modSquare()->addGas(*this, type, amount);
+  if (isValid() && canSeeThruIgnoringGas(VisionId::NORMAL)) {
+    setNeedsRenderAndMemoryUpdate(true);
+    level->tileGas->addAmount(*this, type, amount);
+  }
 }
 
 double Position::getGasAmount(TileGasType type) const {
   PROFILE;
   if (isValid())
-    return getSquare()->getGasAmount(type);
+    return level->tileGas->getAmount(coord, type);
   else
     return 0;
 }
@@ -1010,7 +1031,7 @@ bool Position::isCovered() const {
 bool Position::sunlightBurns() const {
   PROFILE;
   return isValid() && !isCovered() && level->lightCapAmount[coord] >= 1 &&
-      getGame()->getSunlightInfo().getState() == SunlightState::DAY && !getSquare()->hasSunlightBlockingGasAmount();
+      getGame()->getSunlightInfo().getState() == SunlightState::DAY && !level->tileGas->hasSunlightBlockingAmount(coord);
 }
 
 double Position::getLightEmission() const {
@@ -1062,16 +1083,26 @@ void Position::throwItem(vector<PItem> item, const Attack& attack, int maxDist,
 void Position::updateConnectivity() const {
   PROFILE;
   // It's important that sectors aren't generated at this point, because we need stale data to detect change.
-  auto movementEventPredicate = [this] { return level->getSectorsDontCreate({MovementTrait::WALK}).contains(coord); };
-  bool couldEnter = movementEventPredicate();
+  // If the level's sectors haven't been built since loading, there is no previous value and no event is sent.
+  auto movementEventPredicate = [this] () -> optional<bool> {
+    if (auto sectors = getReferenceMaybe(level->sectors, MovementType(MovementTrait::WALK)))
+      return sectors->contains(coord);
+    return none;
+  };
+  auto couldEnter = movementEventPredicate();
   if (isValid()) {
+    // A new kind of dependency only makes equivalent movement types diverge into new keys. The sectors
+    // under the old keys are kept up to date below, so they remain valid.
+    if (level->movementDependencies)
+      level->movementDependencies->sumWith(level->getMovementDependencies(coord));
     for (auto& elem : level->sectors)
       if (canNavigateCalc(elem.first))
         elem.second.add(coord);
       else
         elem.second.remove(coord);
+    level->flowFields->squareChanged(coord);
   }
-  if (couldEnter != movementEventPredicate())
+  if (couldEnter && couldEnter != movementEventPredicate())
     if (auto game = getGame())
       game->addEvent(EventInfo::MovementChanged{*this});
 }
@@ -1207,7 +1238,7 @@ bool Position::canSeeThru(VisionId id, const ContentFactory* factory) const {
   if (!isValid() || !canSeeThruIgnoringGas(id))
     return false;
   for (auto& type : factory->tileGasTypes)
-    if (type.second.blocksVision && getSquare()->getGasAmount(type.first) >= TileGas::getFogVisionCutoff())
+    if (type.second.blocksVision && level->tileGas->getAmount(coord, type.first) >= TileGas::getFogVisionCutoff())
       return false;
   return true;
 }
@@ -1372,3 +1403,248 @@ void Position::putCreature(Creature* c) {
   CHECK(isValid());
   level->putCreature(coord, c);
 }
+
+PositionSet::PositionSet(std::initializer_list<Position> list) : PositionSet(list.begin(), list.end()) {
+}
+
+int PositionSet::getBitIndex(const LevelBits& elem, Vec2 v) {
+  return (v.y - elem.bounds.top()) * elem.bounds.width() + v.x - elem.bounds.left();
+}
+
+const PositionSet::LevelBits* PositionSet::getLevelBits(const Level* level) const {
+  for (auto& elem : levels)
+    if (elem.level == level)
+      return &elem;
+  return nullptr;
+}
+
+PositionSet::LevelBits* PositionSet::getLevelBits(const Level* level) {
+  for (auto& elem : levels)
+    if (elem.level == level)
+      return &elem;
+  return nullptr;
+}
+
+static int getNumWords(const Rectangle& bounds) {
+  return (bounds.width() * bounds.height() + 63) / 64;
+}
+
+PositionSet::LevelBits& PositionSet::getOrInitLevelBits(Level* level, Vec2 v) {
+  CHECK(!!level);
+  const int initialMargin = 8;
+  auto elem = getLevelBits(level);
+  if (!elem) {
+    auto bounds = Rectangle(v - Vec2(initialMargin, initialMargin), v + Vec2(initialMargin, initialMargin));
+    levels.push_back(LevelBits{level, bounds, vector<uint64_t>(getNumWords(bounds), 0)});
+    return levels.back();
+  }
+  if (v.inRectangle(elem->bounds))
+    return *elem;
+  // Grow by half of the current size towards the new coordinate, but not much past the level's own bounds,
+  // so that a series of inserts in one direction doesn't reallocate every time.
+  auto& old = elem->bounds;
+  auto limit = level->getBounds().minusMargin(-2);
+  int px = v.x < old.left() ? max(v.x - old.width() / 2, min(limit.left(), v.x)) : old.left();
+  int py = v.y < old.top() ? max(v.y - old.height() / 2, min(limit.top(), v.y)) : old.top();
+  int kx = v.x >= old.right() ? min(v.x + 1 + old.width() / 2, max(limit.right(), v.x + 1)) : old.right();
+  int ky = v.y >= old.bottom() ? min(v.y + 1 + old.height() / 2, max(limit.bottom(), v.y + 1)) : old.bottom();
+  LevelBits grown {level, Rectangle(px, py, kx, ky), vector<uint64_t>(getNumWords(Rectangle(px, py, kx, ky)), 0)};
+  for (int i : All(elem->bits))
+    for (auto word = elem->bits[i]; word != 0; word &= word - 1) {
+      int index = i * 64 + __builtin_ctzll(word);
+      Vec2 oldPos(old.left() + index % old.width(), old.top() + index / old.width());
+      int newIndex = getBitIndex(grown, oldPos);
+      grown.bits[newIndex / 64] |= uint64_t(1) << (newIndex % 64);
+    }
+  *elem = std::move(grown);
+  return *elem;
+}
+
+bool PositionSet::insert(Position pos) {
+  auto& elem = getOrInitLevelBits(pos.getLevel(), pos.getCoord());
+  int index = getBitIndex(elem, pos.getCoord());
+  auto& word = elem.bits[index / 64];
+  auto mask = uint64_t(1) << (index % 64);
+  if (word & mask)
+    return false;
+  word |= mask;
+  ++numElems;
+  return true;
+}
+
+bool PositionSet::erase(Position pos) {
+  if (auto elem = getLevelBits(pos.getLevel()))
+    if (pos.getCoord().inRectangle(elem->bounds)) {
+      int index = getBitIndex(*elem, pos.getCoord());
+      auto& word = elem->bits[index / 64];
+      auto mask = uint64_t(1) << (index % 64);
+      if (word & mask) {
+        word &= ~mask;
+        --numElems;
+        return true;
+      }
+    }
+  return false;
+}
+
+bool PositionSet::contains(Position pos) const {
+  if (auto elem = getLevelBits(pos.getLevel()))
+    if (pos.getCoord().inRectangle(elem->bounds)) {
+      int index = getBitIndex(*elem, pos.getCoord());
+      return elem->bits[index / 64] & (uint64_t(1) << (index % 64));
+    }
+  return false;
+}
+
+int PositionSet::count(Position pos) const {
+  return contains(pos) ? 1 : 0;
+}
+
+int PositionSet::size() const {
+  return numElems;
+}
+
+bool PositionSet::empty() const {
+  return numElems == 0;
+}
+
+void PositionSet::clear() {
+  levels.clear();
+  numElems = 0;
+}
+
+bool PositionSet::operator == (const PositionSet& other) const {
+  if (size() != other.size())
+    return false;
+  for (auto& pos : *this)
+    if (!other.contains(pos))
+      return false;
+  return true;
+}
+
+bool PositionSet::operator != (const PositionSet& other) const {
+  return !(*this == other);
+}
+
+vector<Position> PositionSet::asVector() const {
+  vector<Position> ret;
+  ret.reserve(size());
+  for (auto& pos : *this)
+    ret.push_back(pos);
+  return ret;
+}
+
+PositionSet::Iterator PositionSet::begin() const {
+  return Iterator(this, 0);
+}
+
+PositionSet::Iterator PositionSet::end() const {
+  return Iterator(this, levels.size());
+}
+
+PositionSet::Iterator::Iterator(const PositionSet* s, int l) : set(s), levelIndex(l) {
+  findFrom(0);
+}
+
+void PositionSet::Iterator::findFrom(int index) {
+  for (; levelIndex < set->levels.size(); ++levelIndex, index = 0) {
+    auto& elem = set->levels[levelIndex];
+    for (int i = index / 64; i < elem.bits.size(); ++i) {
+      auto word = elem.bits[i];
+      if (i == index / 64)
+        word &= ~uint64_t(0) << (index % 64);
+      if (word != 0) {
+        bitIndex = i * 64 + __builtin_ctzll(word);
+        auto& bounds = elem.bounds;
+        current = Position(Vec2(bounds.left() + bitIndex % bounds.width(), bounds.top() + bitIndex / bounds.width()),
+            elem.level);
+        return;
+      }
+    }
+  }
+  bitIndex = 0;
+}
+
+const Position& PositionSet::Iterator::operator* () const {
+  return current;
+}
+
+const Position* PositionSet::Iterator::operator -> () const {
+  return &current;
+}
+
+PositionSet::Iterator& PositionSet::Iterator::operator++ () {
+  findFrom(bitIndex + 1);
+  return *this;
+}
+
+bool PositionSet::Iterator::operator == (const Iterator& other) const {
+  return levelIndex == other.levelIndex && bitIndex == other.bitIndex;
+}
+
+bool PositionSet::Iterator::operator != (const Iterator& other) const {
+  return !(*this == other);
+}
+
+// Sets used to be serialized as a plain unordered_set, which starts with the element count. The compact format
+// starts with a count that can't occur there and stores runs of set bits for each level.
+static const cereal::size_type compactPositionSetTag = std::numeric_limits<cereal::size_type>::max();
+
+template <class Archive>
+void PositionSet::serialize(Archive& ar) {
+  if (Archive::is_saving::value) {
+    auto tag = compactPositionSetTag;
+    ar(cereal::make_size_tag(tag));
+    int numLevels = levels.size();
+    ar(numLevels);
+    for (auto& elem : levels) {
+      vector<pair<int, int>> runs;
+      for (int i : All(elem.bits))
+        for (auto word = elem.bits[i]; word != 0; word &= word - 1) {
+          int index = i * 64 + __builtin_ctzll(word);
+          if (!runs.empty() && runs.back().first + runs.back().second == index)
+            ++runs.back().second;
+          else
+            runs.push_back(make_pair(index, 1));
+        }
+      auto level = elem.level;
+      int px = elem.bounds.left(), py = elem.bounds.top(), kx = elem.bounds.right(), ky = elem.bounds.bottom();
+      ar(level, px, py, kx, ky, runs);
+    }
+  } else {
+    clear();
+    cereal::size_type tag;
+    ar(cereal::make_size_tag(tag));
+    if (tag == compactPositionSetTag) {
+      int numLevels;
+      ar(numLevels);
+      for (int i = 0; i < numLevels; ++i) {
+        Level* level = nullptr;
+        int px, py, kx, ky;
+        vector<pair<int, int>> runs;
+        ar(level, px, py, kx, ky, runs);
+        Rectangle bounds(px, py, kx, ky);
+        LevelBits elem {level, bounds, vector<uint64_t>(getNumWords(bounds), 0)};
+        for (auto& run : runs) {
+          if (run.first < 0 || run.second < 0 || run.first + run.second > bounds.area())
+            throw cereal::Exception("Bad PositionSet run");
+          for (int index = run.first; index < run.first + run.second; ++index)
+            elem.bits[index / 64] |= uint64_t(1) << (index % 64);
+          numElems += run.second;
+        }
+        levels.push_back(std::move(elem));
+      }
+    } else
+      for (cereal::size_type i = 0; i < tag; ++i) {
+        Position pos;
+        ar(pos);
+        insert(pos);
+      }
+  }
+}
+
+template void PositionSet::serialize(InputArchive&);
+template void PositionSet::serialize(OutputArchive&);
+#ifdef MEM_USAGE_TEST
+template void PositionSet::serialize(MemUsageArchive&);
+#endif
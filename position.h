@@ -179,8 +179,93 @@ class Position {
   void updateSupport() const;
   void addFurnitureImpl(PFurniture) const;
   void updateSupportViewId(Furniture*) const;
+  void updateLuxuryNeighbors() const;
 };
 
 TString toString(const Position&);
 
-using PositionSet = HashSet<Position>;
+// Set of positions, kept as a bitmap per level. Each bitmap covers the bounding box of the coordinates
+// inserted on its level, so membership checks don't hash and iteration visits the set bits in order.
+class PositionSet {
+  public:
+  PositionSet() {}
+  PositionSet(std::initializer_list<Position>);
+  template <typename Iter>
+  PositionSet(Iter begin, Iter end) {
+    for (; begin != end; ++begin)
+      insert(*begin);
+  }
+
+  // Return true if the set was modified.
+  bool insert(Position);
+  bool erase(Position);
+  int count(Position) const;
+  bool contains(Position) const;
+  int size() const;
+  bool empty() const;
+  void clear();
+  bool operator == (const PositionSet&) const;
+  bool operator != (const PositionSet&) const;
+
+  class Iterator {
+    public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Position;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Position*;
+    using reference = const Position&;
+    Iterator(const PositionSet*, int levelIndex);
+    const Position& operator* () const;
+    const Position* operator -> () const;
+    Iterator& operator++ ();
+    bool operator == (const Iterator&) const;
+    bool operator != (const Iterator&) const;
+
+    private:
+    void findFrom(int bitIndex);
+    const PositionSet* set;
+    int levelIndex;
+    int bitIndex = 0;
+    Position current;
+  };
+  using iterator = Iterator;
+  using const_iterator = Iterator;
+  Iterator begin() const;
+  Iterator end() const;
+
+  template <typename Fun>
+  auto transform(Fun fun) const {
+    vector<decltype(fun(std::declval<Position>()))> ret;
+    ret.reserve(size());
+    for (const auto& elem : *this)
+      ret.push_back(fun(elem));
+    return ret;
+  }
+
+  template <typename Fun>
+  PositionSet filter(Fun fun) const {
+    PositionSet ret;
+    for (const auto& elem : *this)
+      if (fun(elem))
+        ret.insert(elem);
+    return ret;
+  }
+
+  vector<Position> asVector() const;
+
+  template <class Archive>
+  void serialize(Archive&);
+
+  private:
+  struct LevelBits {
+    Level* level;
+    Rectangle bounds;
+    vector<uint64_t> bits;
+  };
+  vector<LevelBits> levels;
+  int numElems = 0;
+  const LevelBits* getLevelBits(const Level*) const;
+  LevelBits* getLevelBits(const Level*);
+  LevelBits& getOrInitLevelBits(Level*, Vec2);
+  static int getBitIndex(const LevelBits&, Vec2);
+};
@@ -161,10 +161,59 @@ void PositionMap<T>::limitToModel(const Model* m) {
       outliers.erase(elem.first);
 }
 
+// Tables used to be serialized whole, with an empty optional for every missing tile. The compact format only
+// stores the present values and starts with a table count that can't occur in the old one.
+static const cereal::size_type compactPositionMapTag = std::numeric_limits<cereal::size_type>::max();
+
 template <class T>
 template <class Archive>
 void PositionMap<T>::serialize(Archive& ar, const unsigned int version) {
-  ar(tables, outliers);
+  if (Archive::is_saving::value) {
+    auto tag = compactPositionMapTag;
+    ar(cereal::make_size_tag(tag));
+    int numTables = tables.size();
+    ar(numTables);
+    for (auto& elem : tables) {
+      auto levelId = elem.first;
+      auto& table = elem.second;
+      auto bounds = table.getBounds();
+      vector<int> indexes;
+      for (int i : Range(bounds.area()))
+        if (table[Vec2(bounds.left() + i / bounds.height(), bounds.top() + i % bounds.height())])
+          indexes.push_back(i);
+      ar(levelId, bounds, indexes);
+      for (int i : indexes)
+        ar(*table[Vec2(bounds.left() + i / bounds.height(), bounds.top() + i % bounds.height())]);
+    }
+  } else {
+    tables.clear();
+    cereal::size_type tag;
+    ar(cereal::make_size_tag(tag));
+    if (tag == compactPositionMapTag) {
+      int numTables;
+      ar(numTables);
+      for (int i = 0; i < numTables; ++i) {
+        LevelId levelId;
+        Rectangle bounds(0, 0);
+        vector<int> indexes;
+        ar(levelId, bounds, indexes);
+        auto& table = tables.insert(make_pair(levelId, Table<heap_optional<T>>(bounds))).first->second;
+        for (int index : indexes) {
+          if (index < 0 || index >= bounds.area())
+            throw cereal::Exception("Bad PositionMap index");
+          auto& value = table[Vec2(bounds.left() + index / bounds.height(), bounds.top() + index % bounds.height())];
+          value = T();
+          ar(*value);
+        }
+      }
+    } else
+      for (cereal::size_type i = 0; i < tag; ++i) {
+        LevelId levelId;
+        ar(levelId);
+        ar(tables[levelId]);
+      }
+  }
+  ar(outliers);
 }
 
 template <class T>
@@ -0,0 +1,106 @@
+#include "stdafx.h"
+#include "retired_site_index.h"
+#include "file_path.h"
+#include "parse_game.h"
+
+static const char* indexFileName = "retired_site_index.bin";
+
+RetiredSiteIndex::RetiredSiteIndex(const DirectoryPath& d, const string& s, int v)
+    : directory(d), suffix(s), saveVersion(v) {
+}
+
+void RetiredSiteIndex::load() {
+  if (loaded)
+    return;
+  loaded = true;
+  auto path = directory.file(indexFileName);
+  if (!path.exists())
+    return;
+  try {
+    ifstream input(path.getPath(), std::ios::binary);
+    InputArchive archive(input);
+    int version;
+    archive(version);
+    if (version == saveVersion)
+      archive(entries, unreadable);
+  } catch (std::exception& e) {
+    INFO << "Failed to load retired site index " << path << ": " << e.what();
+    entries.clear();
+    unreadable.clear();
+  }
+}
+
+void RetiredSiteIndex::save() const {
+  auto path = directory.file(indexFileName);
+  auto tmpPath = path.withSuffix(".tmp");
+  {
+    ofstream output(tmpPath.getPath(), std::ios::binary);
+    OutputArchive archive(output);
+    archive(saveVersion, entries, unreadable);
+  }
+  tmpPath.copyTo(path);
+  tmpPath.erase();
+}
+
+static optional<RetiredSiteIndex::Entry> readEntry(const FilePath& file) {
+  try {
+    CompressedInput input(file.getPath());
+    RetiredSiteIndex::Entry ret;
+    string name;
+    input.getArchive() >> ret.version >> name >> ret.info;
+    ret.filename = file.getFileName();
+    ret.date = file.getModificationTime();
+    return ret;
+  } catch (std::exception&) {
+    return none;
+  }
+}
+
+const vector<RetiredSiteIndex::Entry>& RetiredSiteIndex::getEntries() {
+  load();
+  map<string, Entry> indexed;
+  for (auto& entry : entries)
+    indexed.insert(make_pair(entry.filename, std::move(entry)));
+  bool changed = false;
+  vector<Entry> current;
+  vector<pair<string, long long>> currentUnreadable;
+  for (auto& file : directory.getFiles())
+    if (file.hasSuffix(suffix)) {
+      auto entry = getReferenceMaybe(indexed, file.getFileName());
+      pair<string, long long> nameAndDate(file.getFileName(), file.getModificationTime());
+      if (entry && entry->date == nameAndDate.second)
+        current.push_back(std::move(*entry));
+      else if (unreadable.contains(nameAndDate))
+        currentUnreadable.push_back(std::move(nameAndDate));
+      else {
+        changed = true;
+        if (auto read = readEntry(file))
+          current.push_back(std::move(*read));
+        else
+          currentUnreadable.push_back(std::move(nameAndDate));
+      }
+    }
+  changed |= current.size() != indexed.size() || currentUnreadable.size() != unreadable.size();
+  unreadable = std::move(currentUnreadable);
+  sort(current.begin(), current.end(), [](const Entry& a, const Entry& b) { return a.date > b.date; });
+  entries = std::move(current);
+  if (changed)
+    save();
+  return entries;
+}
+
+void RetiredSiteIndex::add(const FilePath& file, int version, const SavedGameInfo& info) {
+  load();
+  auto name = file.getFileName();
+  entries = entries.filter([&](const Entry& e) { return e.filename != name; });
+  entries.push_back(Entry{file.getFileName(), file.getModificationTime(), version, info});
+  sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.date > b.date; });
+  save();
+}
+
+void RetiredSiteIndex::remove(const FilePath& file) {
+  load();
+  auto name = file.getFileName();
+  entries = entries.filter([&](const Entry& e) { return e.filename != name; });
+  save();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "util.h"
+#include "saved_game_info.h"
+#include "directory_path.h"
+
+class FilePath;
+
+// Persistent catalog of the headers of retired site saves kept in a directory, so that finding a site
+// doesn't require decompressing every save file.
+class RetiredSiteIndex {
+  public:
+  RetiredSiteIndex(const DirectoryPath&, const string& suffix, int saveVersion);
+
+  struct Entry {
+    string SERIAL(filename);
+    long long SERIAL(date);
+    int SERIAL(version);
+    SavedGameInfo SERIAL(info);
+    SERIALIZE_ALL_NO_VERSION(filename, date, version, info)
+  };
+
+  // Brings the index up to date with the directory, reading headers of new or modified files only.
+  // Entries are sorted from newest to oldest.
+  const vector<Entry>& getEntries();
+  void add(const FilePath&, int version, const SavedGameInfo&);
+  void remove(const FilePath&);
+
+  private:
+  void load();
+  void save() const;
+  DirectoryPath directory;
+  string suffix;
+  int saveVersion;
+  vector<Entry> entries;
+  // Files whose header couldn't be read, with their modification dates, so they are retried only once changed.
+  vector<pair<string, long long>> unreadable;
+  bool loaded = false;
+};
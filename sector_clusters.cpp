@@ -0,0 +1,162 @@
+#include "stdafx.h"
+#include "sector_clusters.h"
+#include "sectors.h"
+
+const int sectorClusterSize = 8;
+// With 8-connectivity a cell can't contain more disjoint components than this.
+const int maxSectorClusterComponents = (sectorClusterSize / 2) * (sectorClusterSize / 2);
+
+bool SectorClusters::Corridor::contains(Vec2 v) const {
+  return cells[(v - origin) / sectorClusterSize];
+}
+
+void SectorClusters::init(Rectangle b) {
+  bounds = b;
+  numCells = Vec2((bounds.width() + sectorClusterSize - 1) / sectorClusterSize,
+      (bounds.height() + sectorClusterSize - 1) / sectorClusterSize);
+  components = Table<signed char>(bounds, -1);
+  dirtyCells = Table<bool>(numCells, true);
+  portals = none;
+}
+
+void SectorClusters::invalidate(Vec2 pos) {
+  if (!bounds.empty())
+    dirtyCells[getCell(pos)] = true;
+}
+
+void SectorClusters::invalidatePortals() {
+  portals = none;
+}
+
+Vec2 SectorClusters::getCell(Vec2 pos) const {
+  return (pos - bounds.topLeft()) / sectorClusterSize;
+}
+
+Vec2 SectorClusters::getNodeCell(NodeId node) const {
+  int index = node / maxSectorClusterComponents;
+  return Vec2(index / numCells.y, index % numCells.y);
+}
+
+Rectangle SectorClusters::getCellBounds(Vec2 cell) const {
+  auto topLeft = bounds.topLeft() + cell * sectorClusterSize;
+  return Rectangle(topLeft, topLeft + Vec2(sectorClusterSize, sectorClusterSize)).intersection(bounds);
+}
+
+void SectorClusters::updateCell(const Sectors& sectors, Vec2 cell) {
+  dirtyCells[cell] = false;
+  auto area = getCellBounds(cell);
+  for (Vec2 v : area)
+    components[v] = -1;
+  signed char numComponents = 0;
+  vector<Vec2> stack;
+  for (Vec2 v : area)
+    if (components[v] == -1 && sectors.contains(v)) {
+      components[v] = numComponents;
+      stack.push_back(v);
+      while (!stack.empty()) {
+        Vec2 pos = stack.back();
+        stack.pop_back();
+        for (Vec2 dir : Vec2::directions8()) {
+          Vec2 next = pos + dir;
+          if (next.inRectangle(area) && components[next] == -1 && sectors.contains(next)) {
+            components[next] = numComponents;
+            stack.push_back(next);
+          }
+        }
+      }
+      ++numComponents;
+    }
+  CHECK(numComponents <= maxSectorClusterComponents);
+}
+
+SectorClusters::NodeId SectorClusters::getNode(const Sectors& sectors, Vec2 pos) {
+  auto cell = getCell(pos);
+  if (dirtyCells[cell])
+    updateCell(sectors, cell);
+  CHECK(components[pos] >= 0);
+  return (cell.x * numCells.y + cell.y) * maxSectorClusterComponents + components[pos];
+}
+
+template <typename Fun>
+void SectorClusters::forEachNeighbor(const Sectors& sectors, NodeId node, Fun fun) {
+  auto cell = getNodeCell(node);
+  signed char component = node % maxSectorClusterComponents;
+  auto area = getCellBounds(cell);
+  for (Vec2 v : area)
+    if (components[v] == component) {
+      if (v.x == area.left() || v.x == area.right() - 1 || v.y == area.top() || v.y == area.bottom() - 1)
+        for (Vec2 dir : Vec2::directions8()) {
+          Vec2 next = v + dir;
+          if (next.inRectangle(bounds) && !next.inRectangle(area) && sectors.contains(next))
+            fun(getNode(sectors, next), sectorClusterSize);
+        }
+      if (auto& other = sectors.extraConnections[v])
+        if (sectors.contains(*other))
+          fun(getNode(sectors, *other), 1);
+    }
+}
+
+bool SectorClusters::hasPortals(const Sectors& sectors) {
+  if (!portals) {
+    portals = false;
+    for (Vec2 v : bounds)
+      if (sectors.extraConnections[v]) {
+        portals = true;
+        break;
+      }
+  }
+  return *portals;
+}
+
+optional<SectorClusters::Corridor> SectorClusters::findCorridor(const Sectors& sectors, Vec2 from, Vec2 to) {
+  PROFILE;
+  if (bounds != sectors.bounds)
+    init(sectors.bounds);
+  if (!sectors.contains(from) || !sectors.contains(to))
+    return none;
+  auto fromNode = getNode(sectors, from);
+  auto toNode = getNode(sectors, to);
+  auto toCell = getCell(to);
+  // Portals make the distance between cells a non-admissible heuristic.
+  bool useHeuristic = !hasPortals(sectors);
+  auto heuristic = [&](NodeId node) {
+    return useHeuristic ? sectorClusterSize * getNodeCell(node).dist8(toCell) : 0;
+  };
+  HashMap<NodeId, int> distance;
+  HashMap<NodeId, NodeId> parent;
+  priority_queue<pair<int, NodeId>, vector<pair<int, NodeId>>, std::greater<pair<int, NodeId>>> q;
+  distance[fromNode] = 0;
+  q.push(make_pair(heuristic(fromNode), fromNode));
+  while (!q.empty()) {
+    auto elem = q.top();
+    q.pop();
+    NodeId node = elem.second;
+    int nodeDist = distance.at(node);
+    if (elem.first > nodeDist + heuristic(node))
+      continue;
+    if (node == toNode)
+      break;
+    forEachNeighbor(sectors, node, [&](NodeId next, int cost) {
+      auto it = distance.find(next);
+      if (it == distance.end() || nodeDist + cost < it->second) {
+        distance[next] = nodeDist + cost;
+        parent[next] = node;
+        q.push(make_pair(nodeDist + cost + heuristic(next), next));
+      }
+    });
+  }
+  if (!distance.count(toNode))
+    return none;
+  Corridor ret;
+  ret.origin = bounds.topLeft();
+  ret.cells = Table<bool>(numCells, false);
+  for (NodeId node = toNode;; node = parent.at(node)) {
+    auto cell = getNodeCell(node);
+    // Include the surrounding cells to give the path search some slack.
+    for (Vec2 v : Rectangle(cell - Vec2(1, 1), cell + Vec2(2, 2)).intersection(ret.cells.getBounds()))
+      ret.cells[v] = true;
+    if (node == fromNode)
+      break;
+  }
+  return ret;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "util.h"
+
+class Sectors;
+
+// A coarse graph built on top of Sectors. The map is split into square cells and every connected component
+// inside a cell becomes a node. Long paths are first searched for in this graph, and the resulting corridor
+// of cells is used to limit the expansions of the full path search.
+class SectorClusters {
+  public:
+  class Corridor {
+    public:
+    bool contains(Vec2) const;
+
+    private:
+    friend class SectorClusters;
+    Vec2 origin;
+    Table<bool> cells;
+  };
+
+  // Returns none if there is no connection between the two positions.
+  optional<Corridor> findCorridor(const Sectors&, Vec2 from, Vec2 to);
+  void invalidate(Vec2);
+  void invalidatePortals();
+
+  private:
+  using NodeId = int;
+  void init(Rectangle bounds);
+  Vec2 getCell(Vec2) const;
+  Vec2 getNodeCell(NodeId) const;
+  Rectangle getCellBounds(Vec2 cell) const;
+  NodeId getNode(const Sectors&, Vec2);
+  void updateCell(const Sectors&, Vec2 cell);
+  template <typename Fun>
+  void forEachNeighbor(const Sectors&, NodeId, Fun);
+  bool hasPortals(const Sectors&);
+  Rectangle bounds;
+  Vec2 numCells;
+  Table<signed char> components;
+  Table<bool> dirtyCells;
+  optional<bool> portals;
+};
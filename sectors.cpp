@@ -18,7 +18,19 @@
 #include "level.h"
 #include <limits>
 
-SERIALIZE_DEF(Sectors, bounds, sectors, allPos, extraConnections)
+template <class Archive>
+void Sectors::serialize(Archive& ar, const unsigned int version) {
+  ar(bounds, sectors);
+  if (version < 1) {
+    vector<HashSet<Vec2>> allPos;
+    ar(allPos);
+    sectorSizes = allPos.transform([](const auto& s) { return (int) s.size(); });
+  } else
+    ar(sectorSizes);
+  ar(extraConnections);
+}
+
+SERIALIZABLE(Sectors)
 
 SERIALIZATION_CONSTRUCTOR_IMPL(Sectors)
 
@@ -38,6 +50,7 @@ bool Sectors::contains(Vec2 v) const {
 bool Sectors::add(Vec2 pos) {
   if (contains(pos))
     return false;
+  clusters.invalidate(pos);
   set<int> neighbors;
   for (Vec2 v : getNeighbors(pos))
     if (v.inRectangle(bounds) && contains(v))
@@ -49,7 +62,7 @@ bool Sectors::add(Vec2 pos) {
   else {
     int largest = -1;
     for (int elem : neighbors)
-      if (largest == -1 || allPos[largest].size() < allPos[elem].size())
+      if (largest == -1 || sectorSizes[largest] < sectorSizes[elem])
         largest = elem;
     join(pos, largest);
   }
@@ -59,21 +72,21 @@ bool Sectors::add(Vec2 pos) {
 void Sectors::setSector(Vec2 pos, SectorId sector) {
   CHECK(sectors[pos] != sector);
   if (contains(pos))
-    allPos[sectors[pos]].erase(pos);
+    --sectorSizes[sectors[pos]];
   sectors[pos] = sector;
-  allPos[sector].insert(pos);
+  ++sectorSizes[sector];
 }
 
 Sectors::SectorId Sectors::getNewSector() {
-  allPos.emplace_back(0);
-  CHECK(allPos.size() < std::numeric_limits<SectorId>::max());
-  return allPos.size() - 1;
+  sectorSizes.push_back(0);
+  CHECK(sectorSizes.size() < std::numeric_limits<SectorId>::max());
+  return sectorSizes.size() - 1;
 }
 
 int Sectors::getNumSectors() const {
   int ret = 0;
-  for (auto& elem : allPos)
-    if (elem.size() > 0)
+  for (auto size : sectorSizes)
+    if (size > 0)
       ++ret;
   return ret;
 }
@@ -93,7 +106,7 @@ void Sectors::join(Vec2 pos1, SectorId sector) {
   }
 }
 
-static DirtyTable<int> bfsTable(Level::getMaxBounds(), -1);
+static thread_local DirtyTable<int> bfsTable(Level::getMaxBounds(), -1);
 
 vector<Vec2> Sectors::getDisjoint(Vec2 pos) const {
   vector<queue<Vec2>> queues;
@@ -131,7 +144,7 @@ vector<Vec2> Sectors::getDisjoint(Vec2 pos) const {
       break;
     }
   }
-  int maxSector = allPos.size() - 1;
+  int maxSector = sectorSizes.size() - 1;
   vector<Vec2> ret;
   for (Vec2 v : getNeighbors(pos))
     if (v.inRectangle(bounds) && sectors[v] <= maxSector && contains(v) &&
@@ -152,7 +165,7 @@ void Sectors::addExtraConnection(Vec2 pos1, Vec2 pos2) {
     auto sector1 = sectors[pos1];
     auto sector2 = sectors[pos2];
     if (sector1 != sector2) {
-      if (allPos[sector1].size() > allPos[sector2].size())
+      if (sectorSizes[sector1] > sectorSizes[sector2])
         join(pos2, sector1);
       else
         join(pos1, sector2);
@@ -162,11 +175,13 @@ void Sectors::addExtraConnection(Vec2 pos1, Vec2 pos2) {
   CHECK(!extraConnections[pos2] || extraConnections[pos2] == pos1);
   extraConnections[pos1] = pos2;
   extraConnections[pos2] = pos1;
+  clusters.invalidatePortals();
 }
 
 void Sectors::removeExtraConnection(Vec2 pos1, Vec2 pos2) {
   extraConnections[pos1] = none;
   extraConnections[pos2] = none;
+  clusters.invalidatePortals();
   join(pos1, getNewSector());
 }
 
@@ -177,14 +192,23 @@ const Sectors::ExtraConnections Sectors::getExtraConnections() const {
 Sectors::SectorId Sectors::getLargest() const {
   PROFILE;
   int ret = 0;
-  for (int i : All(allPos))
-    if (allPos[i].size() > allPos[ret].size())
+  for (int i : All(sectorSizes))
+    if (sectorSizes[i] > sectorSizes[ret])
       ret = i;
   return SectorId(ret);
 }
 
-const Sectors::PosSet& Sectors::getWholeSector(SectorId id) const {
-  return allPos[id];
+vector<Vec2> Sectors::getWholeSector(SectorId id) const {
+  vector<Vec2> ret;
+  int size = sectorSizes[id];
+  ret.reserve(size);
+  for (Vec2 v : bounds) {
+    if (ret.size() == size)
+      break;
+    if (sectors[v] == id)
+      ret.push_back(v);
+  }
+  return ret;
 }
 
 optional<Sectors::SectorId> Sectors::getSector(Vec2 v) const {
@@ -195,10 +219,15 @@ optional<Sectors::SectorId> Sectors::getSector(Vec2 v) const {
     return none;
 }
 
+optional<SectorClusters::Corridor> Sectors::getCorridor(Vec2 from, Vec2 to) {
+  return clusters.findCorridor(*this, from, to);
+}
+
 bool Sectors::remove(Vec2 pos) {
   if (!contains(pos))
     return false;
-  allPos[sectors[pos]].erase(pos);
+  clusters.invalidate(pos);
+  --sectorSizes[sectors[pos]];
   sectors[pos] = -1;
   for (Vec2 v : getDisjoint(pos))
     join(v, getNewSector());
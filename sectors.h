@@ -16,6 +16,7 @@
 #pragma once
 
 #include "util.h"
+#include "sector_clusters.h"
 
 class Sectors {
   public:
@@ -33,12 +34,13 @@ class Sectors {
   void removeExtraConnection(Vec2, Vec2);
   const ExtraConnections getExtraConnections() const;
 
-  using PosSet = HashSet<Vec2>;
   using SectorId = short;
-  const PosSet& getWholeSector(SectorId) const;
+  // Scans the table, so callers should cache the result.
+  vector<Vec2> getWholeSector(SectorId) const;
 
   SectorId getLargest() const;
   optional<SectorId> getSector(Vec2) const;
+  optional<SectorClusters::Corridor> getCorridor(Vec2 from, Vec2 to);
 
   SERIALIZATION_DECL(Sectors)
 
@@ -50,7 +52,10 @@ class Sectors {
   vector<Vec2> getDisjoint(Vec2) const;
   Rectangle SERIAL(bounds);
   Table<SectorId> SERIAL(sectors);
-  vector<PosSet> SERIAL(allPos);
+  vector<int> SERIAL(sectorSizes);
   ExtraConnections SERIAL(extraConnections);
+  friend class SectorClusters;
+  SectorClusters clusters;
 };
 
+CEREAL_CLASS_VERSION(Sectors, 1)
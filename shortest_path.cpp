@@ -21,6 +21,8 @@
 #include "lasting_effect.h"
 #include "furniture.h"
 #include "furniture_usage.h"
+#include "sim_timer.h"
+#include "model.h"
 
 SERIALIZE_DEF(ShortestPath, path, target, bounds, reversed)
 SERIALIZATION_CONSTRUCTOR_IMPL(ShortestPath)
@@ -53,8 +55,9 @@ class DistanceTable {
   int counter = 1;
 };
 
-static DistanceTable distanceTable(Level::getMaxBounds());
-static DirtyTable<double> navigationCostCache(Level::getMaxBounds(), 0);
+// Scratch tables are per thread, so that paths can be computed concurrently.
+static thread_local DistanceTable distanceTable(Level::getMaxBounds());
+static thread_local DirtyTable<double> navigationCostCache(Level::getMaxBounds(), 0);
 
 template <typename Fun>
 static auto getCached(Fun fun) {
@@ -70,6 +73,78 @@ static auto getCached(Fun fun) {
 }
 
 const int margin = 15;
+const int hierarchicalPathMinDist = 30;
+const int flowFieldMinRequests = 3;
+const int flowFieldMaxFields = 8;
+const int flowFieldMaxEntries = 256;
+const TimeInterval flowFieldMaxAge = 3_visible;
+
+struct QueueElem {
+  Vec2 pos;
+  double value;
+};
+
+bool inline operator < (const QueueElem& e1, const QueueElem& e2) {
+  return e1.value > e2.value || (e1.value == e2.value && e1.pos < e2.pos);
+}
+
+using HeapQueue = priority_queue<QueueElem, vector<QueueElem>>;
+
+static thread_local vector<vector<QueueElem>> pathQueueBuckets;
+
+// A queue with one bucket per unit of priority. Movement costs are mostly small integers, so this orders
+// the elements nearly the same way as the heap, but push and pop are constant time.
+class BucketQueue {
+  public:
+  BucketQueue() : buckets(pathQueueBuckets) {}
+
+  ~BucketQueue() {
+    for (int i = 0; i <= maxIndex; ++i)
+      buckets[i].clear();
+  }
+
+  void push(const QueueElem& elem) {
+    int index = max(0, int(elem.value));
+    if (index >= buckets.size())
+      buckets.resize(index + 1);
+    buckets[index].push_back(elem);
+    current = min(current, index);
+    maxIndex = max(maxIndex, index);
+    ++size;
+  }
+
+  const QueueElem& top() {
+    while (buckets[current].empty())
+      ++current;
+    return buckets[current].back();
+  }
+
+  void pop() {
+    top();
+    buckets[current].pop_back();
+    --size;
+  }
+
+  bool empty() const {
+    return size == 0;
+  }
+
+  private:
+  vector<vector<QueueElem>>& buckets;
+  int current = std::numeric_limits<int>::max();
+  int maxIndex = -1;
+  int size = 0;
+};
+
+static std::atomic<PathQueueType> pathQueueType(PathQueueType::BINARY_HEAP);
+
+void ShortestPath::setQueueType(PathQueueType type) {
+  pathQueueType = type;
+}
+
+PathQueueType ShortestPath::getQueueType() {
+  return pathQueueType;
+}
 
 ShortestPath::ShortestPath(Rectangle a, function<double(Vec2)> entryFun, function<double(Vec2)> lengthFun,
     function<vector<Vec2>(Vec2)> directions, Vec2 to, Vec2 from, double mult) : ShortestPath(TemplateConstr{},
@@ -81,10 +156,17 @@ ShortestPath::ShortestPath(TemplateConstr, Rectangle a, EntryFun entryFun, Lengt
   PROFILE;
   CHECK(Level::getMaxBounds().contains(a));
   navigationCostCache.clear();
-  if (mult == 0)
-    init(getCached(entryFun), lengthFun, directions, target, from);
-  else {
-    init(getCached(entryFun), lengthFun, directions, target, none, revShortestLimit);
+  bool buckets = getQueueType() == PathQueueType::BUCKETS;
+  if (mult == 0) {
+    if (buckets)
+      init<BucketQueue>(getCached(entryFun), lengthFun, directions, target, from);
+    else
+      init<HeapQueue>(getCached(entryFun), lengthFun, directions, target, from);
+  } else {
+    if (buckets)
+      init<BucketQueue>(getCached(entryFun), lengthFun, directions, target, none, revShortestLimit);
+    else
+      init<HeapQueue>(getCached(entryFun), lengthFun, directions, target, none, revShortestLimit);
     distanceTable.setDistance(target, infinity);
     navigationCostCache.clear();
     reverse(getCached(entryFun), lengthFun, directions, mult, from);
@@ -97,27 +179,24 @@ ShortestPath::ShortestPath(Rectangle area, function<double (Vec2)> entryFun, fun
 {
 }
 
-struct QueueElem {
-  Vec2 pos;
-  double value;
-};
-
-bool inline operator < (const QueueElem& e1, const QueueElem& e2) {
-  return e1.value > e2.value || (e1.value == e2.value && e1.pos < e2.pos);
+template <typename DirectionsFun>
+ShortestPath::ShortestPath(const FlowField& field, DirectionsFun directions, Vec2 from)
+    : target(field.getTarget()), bounds(field.getBounds()), reversed(false) {
+  PROFILE;
+  CHECK(field.isReachable(from));
+  constructPath(from, [&field](Vec2 v) { return field.getDist(v); }, directions);
 }
 
-template <typename EntryFun, typename LengthFun, typename DirectionsFun>
+template <typename Queue, typename EntryFun, typename LengthFun, typename DirectionsFun>
 void ShortestPath::init(EntryFun entryFun, LengthFun lengthFun, DirectionsFun directions,
     Vec2 target, optional<Vec2> from, optional<int> limit) {
   PROFILE;
   reversed = false;
   distanceTable.clear();
-  function<QueueElem(Vec2)> makeElem;
-  if (from)
-    makeElem = [&](Vec2 pos) ->QueueElem { return {pos, distanceTable.getDistance(pos) + lengthFun(pos)}; };
-  else
-    makeElem = [&](Vec2 pos) ->QueueElem { return {pos, distanceTable.getDistance(pos)}; };
-  priority_queue<QueueElem, vector<QueueElem>> q;
+  auto makeElem = [&](Vec2 pos) ->QueueElem {
+    return {pos, distanceTable.getDistance(pos) + (from ? lengthFun(pos) : 0)};
+  };
+  Queue q;
   distanceTable.setDistance(target, 0);
   q.push(makeElem(target));
   int numPopped = 0;
@@ -129,7 +208,7 @@ void ShortestPath::init(EntryFun entryFun, LengthFun lengthFun, DirectionsFun di
     if (from == pos || (limit && distanceTable.getDistance(pos) >= *limit)) {
       INFO << "Shortest path from " << (from ? *from : Vec2(-1, -1)) << " to " << target << " " << numPopped
         << " visited distance " << distanceTable.getDistance(pos);
-      constructPath(pos, directions);
+      constructPath(pos, [](Vec2 v) { return distanceTable.getDistance(v); }, directions);
       return;
     }
     q.pop();
@@ -175,7 +254,7 @@ void ShortestPath::reverse(function<double(Vec2)> entryFun, function<double(Vec2
     Vec2 pos = q.top().pos;
     if (from == pos) {
       INFO << "Rev shortest path from " << " from " << target << " " << numPopped << " visited";
-      constructPath(pos, directions, true);
+      constructPath(pos, [](Vec2 v) { return distanceTable.getDistance(v); }, directions, true);
       return;
     }
     q.pop();
@@ -191,25 +270,26 @@ void ShortestPath::reverse(function<double(Vec2)> entryFun, function<double(Vec2
   INFO << "Rev shortest path from " << " from " << target << " " << numPopped << " visited";
 }
 
-void ShortestPath::constructPath(Vec2 pos, function<vector<Vec2>(Vec2)> directions, bool reversed) {
+template <typename DistanceFun, typename DirectionsFun>
+void ShortestPath::constructPath(Vec2 pos, DistanceFun getDistance, DirectionsFun directions, bool reversed) {
   vector<Vec2> ret;
   auto origPos = pos;
   while (pos != target) {
     Vec2 next;
-    double lowest = distanceTable.getDistance(pos);
+    double lowest = getDistance(pos);
     CHECK(lowest < infinity);
     for (Vec2 dir : directions(pos)) {
       double dist;
-      if ((pos + dir).inRectangle(bounds) && (dist = distanceTable.getDistance(pos + dir)) < lowest) {
+      if ((pos + dir).inRectangle(bounds) && (dist = getDistance(pos + dir)) < lowest) {
         lowest = dist;
         next = pos + dir;
       }
     }
-    if (lowest >= distanceTable.getDistance(pos)) {
+    if (lowest >= getDistance(pos)) {
       if (reversed)
         break;
       else
-        FATAL << "can't track path " << lowest << " " << distanceTable.getDistance(pos) << " " << origPos
+        FATAL << "can't track path " << lowest << " " << getDistance(pos) << " " << origPos
             << " " << target << " " << pos << " " << next;
     }
     ret.push_back(pos);
@@ -253,18 +333,22 @@ Vec2 ShortestPath::getTarget() const {
   return target;
 }
 
-ShortestPath LevelShortestPath::makeShortestPath(Position from, MovementType movementType, Position to, double mult) {
+ShortestPath LevelShortestPath::makeShortestPath(Position from, MovementType movementType, Position to, double mult,
+    optional<UniqueEntity<Creature>::Id> requester) {
   PROFILE;
+  SIM_TIMER(SimTimerId::PATHFINDING);
   Level* level = from.getLevel();
   Rectangle bounds = level->getBounds();
   CHECK(to.isSameLevel(from));
+  std::unique_lock<std::mutex> lock(level->getPathMutex());
   auto& sectors = level->getSectors(movementType);
   auto& movementSectors = level->getSectors(copyOf(movementType).setCanBuildBridge(false).setDestroyActions({}));
-  auto entryFun = [=, &sectors, &movementSectors, fromCoord = from.getCoord()](Vec2 v) {
+  optional<SectorClusters::Corridor> corridor;
+  auto entryFun = [=, &sectors, &movementSectors, &corridor, fromCoord = from.getCoord()](Vec2 v) {
     PROFILE_BLOCK("entry fun");
     if (fromCoord == v)
       return 1.0;
-    if (!sectors.contains(v))
+    if (!sectors.contains(v) || (corridor && !corridor->contains(v)))
       return ShortestPath::infinity;
     return Position(v, level, Position::IsValid{}).getNavigationCost(movementType, movementSectors);
   };
@@ -283,6 +367,29 @@ ShortestPath LevelShortestPath::makeShortestPath(Position from, MovementType mov
   CHECK(to.getCoord().inRectangle(level->getBounds()));
   CHECK(from.getCoord().inRectangle(level->getBounds()));
   if (mult == 0) {
+    // Many creatures heading to the same target share a single distance field.
+    auto fieldEntryFun = [=, &sectors, &movementSectors](Vec2 v) {
+      if (!sectors.contains(v))
+        return ShortestPath::infinity;
+      return Position(v, level, Position::IsValid{}).getNavigationCost(movementType, movementSectors);
+    };
+    auto& flowFields = level->getFlowFields();
+    auto time = level->getModel()->getLocalTime();
+    auto field = flowFields.get(to.getCoord(), movementType, time, requester);
+    if (!field && flowFields.needsField(to.getCoord(), movementType)) {
+      // The search over the whole level runs unlocked, so that other paths on the level aren't held up by it.
+      lock.unlock();
+      FlowField newField(ShortestPath::TemplateConstr{}, bounds, to.getCoord(), fieldEntryFun, directionsFun);
+      lock.lock();
+      field = flowFields.add(to.getCoord(), movementType, time, std::move(newField));
+    }
+    if (field && field->isReachable(from.getCoord()))
+      return ShortestPath(*field, directionsFun, from.getCoord());
+    // For long paths find a corridor in the coarse sector graph first and only search inside of it.
+    if (from.getCoord().dist8(to.getCoord()) > hierarchicalPathMinDist &&
+        movementSectors.same(from.getCoord(), to.getCoord()))
+      corridor = movementSectors.getCorridor(from.getCoord(), to.getCoord());
+    lock.unlock();
     auto dist1 = from.getDistanceToNearestPortal().value_or(10000);
     auto lengthFun = [level, from = from.getCoord(), dist1](Vec2 to) {
       PROFILE_BLOCK("length fun");
@@ -292,6 +399,7 @@ ShortestPath LevelShortestPath::makeShortestPath(Position from, MovementType mov
     };
     return ShortestPath(ShortestPath::TemplateConstr{}, bounds, entryFun, lengthFun, directionsFun, to.getCoord(), from.getCoord(), mult);
   } else {
+    lock.unlock();
     auto lengthFun = [from = from.getCoord()](Vec2 to)->double { return from.dist8(to); };
     Vec2 vTo = to.getCoord();
     Vec2 vFrom = from.getCoord();
@@ -306,10 +414,22 @@ SERIALIZATION_CONSTRUCTOR_IMPL(LevelShortestPath);
 
 
 LevelShortestPath::LevelShortestPath(const Creature* creature, Position target, double mult)
-    : LevelShortestPath(creature->getPosition(), creature->getMovementType(), target, mult) {}
+    : LevelShortestPath(creature->getPosition(), creature->getMovementType(), target, mult,
+        creature->getUniqueId()) {}
+
+LevelShortestPath::LevelShortestPath(Position from, MovementType type, Position to, double mult,
+    optional<UniqueEntity<Creature>::Id> requester)
+    : path(makeShortestPath(from, type, to, mult, requester)), level(to.getLevel()) {
+}
 
-LevelShortestPath::LevelShortestPath(Position from, MovementType type, Position to, double mult)
-    : path(makeShortestPath(from, type, to, mult)), level(to.getLevel()) {
+vector<LevelShortestPath> LevelShortestPath::computeAll(const vector<Request>& requests) {
+  PROFILE;
+  vector<optional<LevelShortestPath>> ret(requests.size());
+  runParallel(requests.size(), [&](int index) {
+    auto& request = requests[index];
+    ret[index] = LevelShortestPath(request.from, request.movementType, request.to, request.mult, request.requester);
+  });
+  return ret.transform([](auto& path) { return std::move(*path); });
 }
 
 Level* LevelShortestPath::getLevel() const {
@@ -399,6 +519,138 @@ const Dijkstra::DistanceMap& Dijkstra::getAllReachable() const {
   return reachable;
 }
 
+FlowField::FlowField(Rectangle bounds, Vec2 target, function<double(Vec2)> entryFun,
+    function<vector<Vec2>(Vec2)> directions)
+    : FlowField(ShortestPath::TemplateConstr{}, bounds, target, entryFun, directions) {
+}
+
+template <typename EntryFun, typename DirectionsFun>
+FlowField::FlowField(ShortestPath::TemplateConstr, Rectangle bounds, Vec2 target, EntryFun entryFun,
+    DirectionsFun directions)
+    : bounds(bounds), target(target), distance(bounds, ShortestPath::infinity) {
+  PROFILE;
+  priority_queue<QueueElem, vector<QueueElem>> q;
+  distance[target] = 0;
+  q.push({target, 0});
+  int numPopped = 0;
+  while (!q.empty()) {
+    auto elem = q.top();
+    q.pop();
+    if (elem.value > distance[elem.pos])
+      continue;
+    ++numPopped;
+    for (Vec2 dir : directions(elem.pos)) {
+      Vec2 next = elem.pos + dir;
+      if (next.inRectangle(bounds) && elem.value < distance[next]) {
+        double entry = entryFun(next);
+        if (entry >= ShortestPath::infinity)
+          continue;
+        CHECK(entry > 0) << "Entry fun non positive " << entry;
+        double dist = elem.value + entry;
+        if (dist < distance[next]) {
+          distance[next] = dist;
+          q.push({next, dist});
+        }
+      }
+    }
+  }
+  INFO << "Flow field to " << target << " " << numPopped << " visited";
+}
+
+bool FlowField::isReachable(Vec2 v) const {
+  return v.inRectangle(bounds) && distance[v] < ShortestPath::infinity;
+}
+
+double FlowField::getDist(Vec2 v) const {
+  return distance[v];
+}
+
+Vec2 FlowField::getTarget() const {
+  return target;
+}
+
+Rectangle FlowField::getBounds() const {
+  return bounds;
+}
+
+const FlowField* FlowFieldCache::get(Vec2 target, const MovementType& movement, LocalTime time,
+    optional<Requester> requester) {
+  auto key = make_pair(target, movement);
+  if (!entries.count(key) && entries.size() >= flowFieldMaxEntries) {
+    removeExpired(time);
+    if (entries.size() >= flowFieldMaxEntries)
+      removeOldest();
+  }
+  auto& entry = entries.emplace(key, Entry{time, {}, nullptr}).first->second;
+  if (entry.time + flowFieldMaxAge < time)
+    entry = Entry{time, {}, nullptr};
+  if (!entry.field && requester && entry.requesters.size() < flowFieldMinRequests &&
+      !entry.requesters.contains(*requester))
+    entry.requesters.push_back(*requester);
+  return entry.field.get();
+}
+
+bool FlowFieldCache::needsField(Vec2 target, const MovementType& movement) const {
+  if (auto entry = getReferenceMaybe(entries, make_pair(target, movement)))
+    return !entry->field && entry->requesters.size() >= flowFieldMinRequests;
+  return false;
+}
+
+const FlowField* FlowFieldCache::add(Vec2 target, const MovementType& movement, LocalTime time, FlowField field) {
+  auto key = make_pair(target, movement);
+  if (auto entry = getReferenceMaybe(entries, key))
+    if (entry->field)
+      return entry->field.get();
+  int numFields = 0;
+  optional<pair<Vec2, MovementType>> oldest;
+  for (auto& elem : entries)
+    if (elem.second.field) {
+      ++numFields;
+      if (!oldest || elem.second.time < entries.at(*oldest).time)
+        oldest = elem.first;
+    }
+  if (numFields >= flowFieldMaxFields)
+    entries.erase(*oldest);
+  auto& entry = entries.emplace(key, Entry{time, {}, nullptr}).first->second;
+  entry.time = time;
+  entry.field = make_unique<FlowField>(std::move(field));
+  return entry.field.get();
+}
+
+void FlowFieldCache::removeExpired(LocalTime time) {
+  for (auto it = entries.begin(); it != entries.end();)
+    if (it->second.time + flowFieldMaxAge < time)
+      it = entries.erase(it);
+    else
+      ++it;
+}
+
+void FlowFieldCache::removeOldest() {
+  auto oldest = entries.begin();
+  for (auto it = entries.begin(); it != entries.end(); ++it)
+    if (it->second.time < oldest->second.time)
+      oldest = it;
+  if (oldest != entries.end())
+    entries.erase(oldest);
+}
+
+// A square that was reachable may now cost more or be blocked, and one next to a reachable square
+// may have opened a shorter way. The requesters are kept, so the field is rebuilt on the next request.
+void FlowFieldCache::squareChanged(Vec2 pos) {
+  for (auto& elem : entries)
+    if (auto& field = elem.second.field) {
+      bool affected = field->isReachable(pos);
+      for (auto dir : Vec2::directions8())
+        affected = affected || field->isReachable(pos + dir);
+      if (affected)
+        field.reset();
+    }
+}
+
+void FlowFieldCache::clear() {
+  entries.clear();
+}
+
 BfSearch::BfSearch(Rectangle bounds, Vec2 from, function<bool(Vec2)> entryFun, vector<Vec2> directions) {
   distanceTable.clear();
   queue<Vec2> q;
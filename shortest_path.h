@@ -19,9 +19,17 @@
 
 #include "util.h"
 #include "position.h"
+#include "movement_type.h"
+#include "unique_entity.h"
 
 class Creature;
 class Level;
+class FlowField;
+
+RICH_ENUM(PathQueueType,
+  BINARY_HEAP,
+  BUCKETS
+);
 
 class ShortestPath {
   public:
@@ -47,6 +55,9 @@ class ShortestPath {
       Vec2 target,
       Vec2 from,
       double mult = 0);
+
+  template <typename DirectionsFun>
+  ShortestPath(const FlowField&, DirectionsFun directions, Vec2 from);
   bool isReachable(Vec2 pos) const;
   Vec2 getNextMove(Vec2 pos);
   optional<Vec2> getNextNextMove(Vec2 pos);
@@ -56,15 +67,20 @@ class ShortestPath {
 
   static const double infinity;
 
+  // Selects the priority queue used by all subsequent searches.
+  static void setQueueType(PathQueueType);
+  static PathQueueType getQueueType();
+
   SERIALIZATION_DECL(ShortestPath)
 
   private:
-  template <typename EntryFun, typename LengthFun, typename DirectionsFun>
+  template <typename Queue, typename EntryFun, typename LengthFun, typename DirectionsFun>
   void init(EntryFun entryFun, LengthFun lengthFun, DirectionsFun directions,
       Vec2 target, optional<Vec2> from, optional<int> limit = none);
   void reverse(function<double(Vec2)> entryFun, function<double(Vec2)> lengthFun,
       function<vector<Vec2>(Vec2)> directions, double mult, Vec2 from);
-  void constructPath(Vec2 start, function<vector<Vec2>(Vec2)> directions, bool reversed = false);
+  template <typename DistanceFun, typename DirectionsFun>
+  void constructPath(Vec2 start, DistanceFun, DirectionsFun directions, bool reversed = false);
   vector<Vec2> SERIAL(path);
   Vec2 SERIAL(target);
   Rectangle SERIAL(bounds);
@@ -74,7 +90,18 @@ class ShortestPath {
 class LevelShortestPath {
   public:
   LevelShortestPath(const Creature* creature, Position target, double mult = 0);
-  LevelShortestPath(Position from, MovementType, Position target, double mult = 0);
+  // The requester is counted when deciding whether many creatures are heading to the same target.
+  LevelShortestPath(Position from, MovementType, Position target, double mult = 0,
+      optional<UniqueEntity<Creature>::Id> requester = none);
+  struct Request {
+    Position from;
+    MovementType movementType;
+    Position to;
+    double mult;
+    optional<UniqueEntity<Creature>::Id> requester;
+  };
+  // Computes the paths on the worker pool. The levels must not change until it returns.
+  static vector<LevelShortestPath> computeAll(const vector<Request>&);
   bool isReachable(Position) const;
   Position getNextMove(Position);
   optional<Position> getNextNextMove(Position);
@@ -88,7 +115,8 @@ class LevelShortestPath {
   SERIALIZATION_DECL(LevelShortestPath)
 
   private:
-  static ShortestPath makeShortestPath(Position, MovementType, Position to, double mult);
+  static ShortestPath makeShortestPath(Position, MovementType, Position to, double mult,
+      optional<UniqueEntity<Creature>::Id> requester);
   ShortestPath SERIAL(path);
   Level* SERIAL(level) = nullptr;
 };
@@ -106,6 +134,49 @@ class Dijkstra {
   DistanceMap reachable;
 };
 
+// Distance to a single target from every square of the level, shared by all creatures heading there.
+class FlowField {
+  public:
+  FlowField(Rectangle bounds, Vec2 target, function<double(Vec2)> entryFun,
+      function<vector<Vec2>(Vec2)> directions);
+  template <typename EntryFun, typename DirectionsFun>
+  FlowField(ShortestPath::TemplateConstr, Rectangle bounds, Vec2 target, EntryFun entryFun, DirectionsFun directions);
+  bool isReachable(Vec2) const;
+  double getDist(Vec2) const;
+  Vec2 getTarget() const;
+  Rectangle getBounds() const;
+
+  private:
+  Rectangle bounds;
+  Vec2 target;
+  Table<double> distance;
+};
+
+class FlowFieldCache {
+  public:
+  using Requester = UniqueEntity<Creature>::Id;
+  // Records who asked for a path to the target and returns the field to it if one was built.
+  // Requests without a requester are never counted.
+  const FlowField* get(Vec2 target, const MovementType&, LocalTime, optional<Requester>);
+  // Whether enough different creatures asked for paths to the target recently to make building a field worth it.
+  bool needsField(Vec2 target, const MovementType&) const;
+  // Stores a newly built field, unless one was added in the meantime, and returns the stored one.
+  const FlowField* add(Vec2 target, const MovementType&, LocalTime, FlowField);
+  // Drops the fields that a change of navigation through the square can affect.
+  void squareChanged(Vec2);
+  void clear();
+
+  private:
+  void removeExpired(LocalTime);
+  void removeOldest();
+  struct Entry {
+    LocalTime time;
+    vector<Requester> requesters;
+    unique_ptr<FlowField> field;
+  };
+  HashMap<pair<Vec2, MovementType>, Entry> entries;
+};
+
 class BfSearch {
   public:
   BfSearch(Rectangle bounds, Vec2 from, function<bool(Vec2)> entryFun, vector<Vec2> directions = Vec2::directions8());
@@ -0,0 +1,35 @@
+#include "stdafx.h"
+#include "sim_timer.h"
+
+static atomic<bool> simTimersEnabled { false };
+static atomic<long long> simTimerValues[EnumInfo<SimTimerId>::size];
+
+void SimTimers::setEnabled(bool s) {
+  simTimersEnabled = s;
+}
+
+bool SimTimers::isEnabled() {
+  return simTimersEnabled;
+}
+
+void SimTimers::add(SimTimerId id, microseconds time) {
+  simTimerValues[int(id)] += time.count();
+}
+
+EnumMap<SimTimerId, microseconds> SimTimers::getAndClear() {
+  return EnumMap<SimTimerId, microseconds>([](SimTimerId id) {
+    return microseconds(simTimerValues[int(id)].exchange(0));
+  });
+}
+
+SimTimer::SimTimer(SimTimerId id) {
+  if (simTimersEnabled) {
+    this->id = id;
+    start = steady_clock::now();
+  }
+}
+
+SimTimer::~SimTimer() {
+  if (id)
+    SimTimers::add(*id, duration_cast<microseconds>(steady_clock::now() - start));
+}
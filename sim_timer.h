@@ -0,0 +1,33 @@
+#pragma once
+
+#include "util.h"
+
+RICH_ENUM(SimTimerId,
+  CREATURE_MOVE,
+  MODEL_TICK,
+  COLLECTIVE_TICK,
+  LEVEL_TICK,
+  PATHFINDING
+);
+
+// Accumulates wall time spent in major simulation subsystems. Used by the headless simulation benchmark,
+// timers are no-ops unless enabled. Times are inclusive, so nested subsystems are counted in their parent as well.
+class SimTimers {
+  public:
+  static void setEnabled(bool);
+  static bool isEnabled();
+  static void add(SimTimerId, microseconds);
+  static EnumMap<SimTimerId, microseconds> getAndClear();
+};
+
+class SimTimer {
+  public:
+  SimTimer(SimTimerId);
+  ~SimTimer();
+
+  private:
+  optional<SimTimerId> id;
+  steady_clock::time_point start;
+};
+
+#define SIM_TIMER(id) SimTimer CONCAT(simTimer, __LINE__)(id)
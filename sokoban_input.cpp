@@ -31,7 +31,11 @@ static int getTableNum(const FilePath& path) {
   return ret;
 }
 
+static std::mutex stateMutex;
+
 Table<char> SokobanInput::getNext() {
+  // Sites may be generated in parallel and they all advance the same state file.
+  std::lock_guard<std::mutex> lock(stateMutex);
   ifstream input(levelsPath.getPath());
   CHECK(input) << "Failed to load sokoban data from " << levelsPath;
   vector<Table<char>> rest;
@@ -35,10 +35,21 @@
 #include "content_factory.h"
 #include "tile_gas_info.h"
 
+struct Square::LegacyGas {
+  TileGas::LegacyAmounts SERIAL(amount);
+  SERIALIZE_ALL(amount)
+};
+
 template <class Archive> 
 void Square::serialize(Archive& ar, const unsigned int version) { 
   ar(inventory, onFire);
-  ar(creature, landingLink, tileGas);
+  ar(creature, landingLink);
+  if (version == 0) {
+    LegacyGas gas;
+    ar(gas);
+    if (!gas.amount.empty())
+      legacyGas = make_unique<LegacyGas>(std::move(gas));
+  }
   ar(lastViewer, viewIndex);
   ar(forbiddenTribe);
 }
@@ -92,7 +103,6 @@ void Square::tick(Position pos) {
           break;
         }
   }
-  tileGas->tick(pos);
 }
 
 bool Square::itemLands(vector<Item*> item, const Attack& attack) const {
@@ -122,26 +132,6 @@ void Square::onItemLands(Position pos, vector<PItem> item, const Attack& attack)
     pos.dropItems(std::move(item));
 }
 
-void Square::addGas(Position pos, TileGasType type, double amount) {
-  setDirty(pos);
-  if (pos.canSeeThruIgnoringGas(VisionId::NORMAL)) {
-    tileGas->addAmount(pos, type, amount);
-    pos.getLevel()->addTickingSquare(pos.getCoord());
-  }
-}
-
-void Square::addPermanentGas(TileGasType type, double amount) {
-  tileGas->addPermanentAmount(type, amount);
-}
-
-double Square::getGasAmount(TileGasType type) const {
-  return tileGas->getAmount(type);
-}
-
-bool Square::hasSunlightBlockingGasAmount() const {
-  return tileGas->hasSunlightBlockingAmount();
-}
-
 void Square::getViewIndex(const ContentFactory* factory, ViewIndex& ret, const Creature* viewer) const {
   if ((!viewer && lastViewer) || (viewer && lastViewer == viewer->getUniqueId())) {
     ret = *viewIndex;
@@ -159,12 +149,6 @@ void Square::getViewIndex(const ContentFactory* factory, ViewIndex& ret, const C
       }
     ret.insert(std::move(obj));
   }
-  CHECK(ret.getGasAmounts().empty());
-  for (auto& type : factory->tileGasTypes) {
-    auto amount = tileGas->getAmount(type.first);
-    if (amount > 0)
-      ret.addGasAmount(type.second.name, type.second.color.transparency(amount * 255));
-  }
   *viewIndex = ret;
 }
 
@@ -213,6 +197,13 @@ void Square::setDirty(Position pos) {
   lastViewer.reset();
 }
 
+void Square::moveLegacyGas(Vec2 pos, TileGas& gas) {
+  if (legacyGas) {
+    gas.addLegacyAmounts(pos, legacyGas->amount);
+    legacyGas.reset();
+  }
+}
+
 void Square::forbidMovementForTribe(Position pos, TribeId tribe) {
   CHECK(!forbiddenTribe || forbiddenTribe == tribe);
   forbiddenTribe = tribe;
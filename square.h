@@ -42,11 +42,6 @@ class Square {
   /** Returns the entry point details. Returns none if square is not entry point. See setLandingLink().*/
   optional<StairKey> getLandingLink() const;
 
-  void addGas(Position, TileGasType, double amount);
-  void addPermanentGas(TileGasType, double amount);
-  double getGasAmount(TileGasType) const;
-  bool hasSunlightBlockingGasAmount() const;
-
   /** Sets the level this square is on.*/
   void onAddedToLevel(Position) const;
 
@@ -92,6 +87,7 @@ class Square {
 
   void clearItemIndex(ItemIndex);
   void setDirty(Position);
+  void moveLegacyGas(Vec2, TileGas&);
 
   const Inventory& getInventory() const;
 
@@ -102,9 +98,12 @@ class Square {
   HeapAllocated<Inventory> SERIAL(inventory);
   Creature* SERIAL(creature) = nullptr;
   optional<StairKey> SERIAL(landingLink);
-  HeapAllocated<TileGas> SERIAL(tileGas);
+  struct LegacyGas;
+  unique_ptr<LegacyGas> legacyGas;
   mutable optional<UniqueEntity<Creature>::Id> SERIAL(lastViewer);
   unique_ptr<ViewIndex> SERIAL(viewIndex);
   optional<TribeId> SERIAL(forbiddenTribe);
   bool SERIAL(onFire) = false;
 };
+
+CEREAL_CLASS_VERSION(Square, 1)
@@ -24,6 +24,9 @@
 #include "test.h"
 #include "sectors.h"
 #include "minion_equipment.h"
+#include "equipment.h"
+#include "item_upgrade_info.h"
+#include "item_prefix.h"
 #include "item_factory.h"
 #include "item_type.h"
 #include "creature.h"
@@ -48,6 +51,17 @@
 #include "biome_id.h"
 #include "item_types.h"
 #include "creature_attributes.h"
+#include "time_queue.h"
+#include "field_of_view.h"
+#include "furniture_type.h"
+#include "tech_id.h"
+#include "position_map.h"
+#include "tile_gas.h"
+#include "square.h"
+#include "inventory.h"
+#include "view_index.h"
+#include "stair_key.h"
+#include "tribe.h"
 
 class Test {
   public:
@@ -80,6 +94,118 @@ class Test {
     CHECK(q.getNextCreature() == ra);*/
   }
 
+  // Replays random scheduling operations against the previous map based queue and checks that creatures
+  // move in the same order.
+  void testTimeQueueOrder() {
+    struct ReferenceQueue {
+      using Time = pair<int, bool>;
+      map<Time, deque<Creature*>> queue;
+      map<Creature*, Time> times;
+      map<Creature*, int> order;
+      void clearNull(deque<Creature*>& q) {
+        while (!q.empty() && !q.back())
+          q.pop_back();
+        while (!q.empty() && !q.front())
+          q.pop_front();
+      }
+      void push(Creature* c, Time time, bool front = false) {
+        auto& q = queue[time];
+        clearNull(q);
+        order[c] = q.empty() ? 1000000000 : front ? order[q.front()] - 1 : order[q.back()] + 1;
+        if (front)
+          q.push_front(c);
+        else
+          q.push_back(c);
+        times[c] = time;
+      }
+      void erase(Creature* c) {
+        for (auto& elem : queue.at(times.at(c)))
+          if (elem == c)
+            elem = nullptr;
+      }
+      Creature* getNext() {
+        while (true) {
+          clearNull(queue.begin()->second);
+          if (!queue.begin()->second.empty())
+            return queue.begin()->second.front();
+          queue.erase(queue.begin());
+        }
+      }
+      bool willMoveThisTurn(Creature* c) {
+        auto cur = queue.begin()->first;
+        return times.at(c).first == cur.first && (!times.at(c).second || cur.second);
+      }
+      bool compareOrder(Creature* c1, Creature* c2) {
+        if (willMoveThisTurn(c1) != willMoveThisTurn(c2))
+          return willMoveThisTurn(c2);
+        if (!willMoveThisTurn(c1))
+          return false;
+        if (times.at(c1) != times.at(c2))
+          return times.at(c1) < times.at(c2);
+        return order.at(c1) < order.at(c2);
+      }
+    };
+    RandomGen random;
+    random.init(123);
+    TimeQueue q;
+    ReferenceQueue ref;
+    vector<PCreature> removed;
+    for (int i : Range(200)) {
+      auto c = CreatureFactory::getHumanForTests();
+      auto time = random.get(5);
+      ref.push(c.get(), {time, false});
+      q.addCreature(std::move(c), LocalTime(time));
+    }
+    for (int i : Range(100000)) {
+      auto next = q.getNextCreature(1000000);
+      CHECK(next == ref.getNext());
+      auto other = random.choose(q.getAllCreatures());
+      CHECK(q.compareOrder(next, other) == ref.compareOrder(next, other));
+      CHECK(q.willMoveThisTurn(other) == ref.willMoveThisTurn(other));
+      auto time = ref.times.at(next);
+      switch (random.get(10)) {
+        case 0:
+          ref.erase(next);
+          ref.push(next, time.second ? make_pair(time.first + 1, false) : make_pair(time.first, true));
+          q.makeExtraMove(next);
+          break;
+        case 1:
+          ref.erase(next);
+          ref.push(next, time);
+          q.postponeMove(next);
+          break;
+        case 2:
+          ref.erase(other);
+          ref.push(other, ref.times.at(other), true);
+          q.moveNow(other);
+          break;
+        case 3:
+          if (q.getAllCreatures().size() > 1) {
+            ref.erase(next);
+            removed.push_back(q.removeCreature(next));
+            break;
+          }
+          FALLTHROUGH;
+        case 4:
+          if (!removed.empty()) {
+            auto c = std::move(removed.back());
+            removed.pop_back();
+            auto addTime = time.first + random.get(-1, 200);
+            ref.push(c.get(), {addTime, false});
+            q.addCreature(std::move(c), LocalTime(addTime));
+          }
+          FALLTHROUGH;
+        default: {
+          int diff = random.get(1, 4);
+          ref.erase(next);
+          ref.push(next, {time.first + diff, false});
+          q.increaseTime(next, TimeInterval(diff));
+          break;
+        }
+      }
+    }
+  }
+
   void testRectangleIterator() {
     vector<Vec2> v1, v2;
     for (Vec2 v : Rectangle(10, 10)) {
@@ -175,6 +301,57 @@ class Test {
     CHECK(res == expected);
   }
 
+  void testShortestPathBuckets() {
+    ShortestPath::setQueueType(PathQueueType::BUCKETS);
+    OnExit onExit([] { ShortestPath::setQueueType(PathQueueType::BINARY_HEAP); });
+    vector<vector<double> > table { { 2, 1, 2, 18, 1}, { 1, 1, 18, 1, 2}, {2, 6, 10, 1,1}, {1, 2, 1, 8, 1}, {5, 3, 1, 1, 2}};
+    ShortestPath path(Rectangle(5, 5),
+        [table](Vec2 pos) { return table[pos.y][pos.x];},
+        [] (Vec2 to) { return Vec2(1, 0).dist4(to); },
+        Vec2::directions4(), Vec2(4, 0), Vec2(1, 0));
+    vector<Vec2> expected {Vec2(1, 0), Vec2(1, 1), Vec2(0, 1), Vec2(0, 2), Vec2(0, 3), Vec2(1, 3), Vec2(2, 3), Vec2(2, 4), Vec2(3, 4), Vec2(4, 4), Vec2(4, 3), Vec2(4, 2), Vec2(4, 1), Vec2(4, 0)};
+    CHECK(path.getPath().reverse() == expected);
+  }
+
+  void testShortestPathParallel() {
+    vector<vector<double> > table { { 2, 1, 2, 18, 1}, { 1, 1, 18, 1, 2}, {2, 6, 10, 1,1}, {1, 2, 1, 8, 1}, {5, 3, 1, 1, 2}};
+    vector<vector<Vec2>> paths(32);
+    runParallel(paths.size(), [&](int index) {
+      ShortestPath path(Rectangle(5, 5),
+          [table](Vec2 pos) { return table[pos.y][pos.x];},
+          [] (Vec2 to) { return Vec2(1, 0).dist4(to); },
+          Vec2::directions4(), Vec2(4, 0), Vec2(1, 0));
+      paths[index] = path.getPath();
+    }, 4);
+    for (auto& path : paths)
+      CHECK(path == paths[0] && path.size() == 14);
+  }
+
+  void testRunParallelRandom() {
+    Random.init(123);
+    vector<int> expected;
+    for (int i : Range(5))
+      expected.push_back(Random.get(1000));
+    Random.init(123);
+    auto childSeed = Random.getChildSeed();
+    // Jobs that run on the calling thread don't change its sequence.
+    runParallel(10, [](int) { Random.get(1000); }, 1);
+    vector<int> values;
+    for (int i : Range(5))
+      values.push_back(Random.get(1000));
+    CHECK(values == expected);
+    // Threads get the same seeds in every run with the same seed.
+    Random.init(123);
+    CHECKEQ(Random.getChildSeed(), childSeed);
+    CHECK(Random.getChildSeed() != childSeed);
+    vector<int> fromThread(2);
+    for (int i : Range(2)) {
+      Random.init(123);
+      makeScopedThread([&] { fromThread[i] = Random.get(1000000); });
+    }
+    CHECKEQ(fromThread[0], fromThread[1]);
+  }
+
   void testAStar() {
     vector<vector<double> > table { { 1, 1, 6, 1, 1}, { 1, 1, 6, 1, 1}, {1, 1, 1, 1,1}, {1, 1, 6, 1, 1}, {1, 1, 6, 1, 1}};
     ShortestPath path(Rectangle(5, 5),
@@ -540,6 +717,25 @@ class Test {
     CHECK(!s.same(Vec2(0, 0), Vec2(5, 5)));
   }
 
+  void testSectorCorridor() {
+    Rectangle bounds(100, 60);
+    Sectors s(bounds, Table<optional<Vec2>>(bounds));
+    for (Vec2 v : bounds)
+      if (v.x != 50 || v.y == 55)
+        s.add(v);
+    auto corridor = s.getCorridor(Vec2(2, 2), Vec2(97, 3));
+    CHECK(!!corridor);
+    CHECK(corridor->contains(Vec2(2, 2)));
+    CHECK(corridor->contains(Vec2(97, 3)));
+    CHECK(corridor->contains(Vec2(50, 55)));
+    s.remove(Vec2(50, 55));
+    CHECK(!s.getCorridor(Vec2(2, 2), Vec2(97, 3)));
+    s.addExtraConnection(Vec2(10, 10), Vec2(90, 10));
+    corridor = s.getCorridor(Vec2(2, 2), Vec2(97, 3));
+    CHECK(!!corridor);
+    CHECK(!corridor->contains(Vec2(50, 55)));
+  }
+
   void testReverse() {
     vector<int> v1 {1, 2, 3, 4};
     vector<int> v2 {4, 3, 2, 1};
@@ -799,6 +995,27 @@ class Test {
     CHECK(equipment.getItemsOwnedBy(human.get()).size() == items.size());
   }
 
+  void testEquippedItemUpgrade() {
+    auto contentFactory = getContentFactory();
+    PCreature human = CreatureFactory::getHumanForTests();
+    PItem helmet = ItemType(CustomItemId("LeatherHelm")).get(&contentFactory);
+    auto helmetPtr = helmet.get();
+    human->take(std::move(helmet), &contentFactory);
+    if (!human->getEquipment().isEquipped(helmetPtr))
+      human->getEquipment().equip(helmetPtr, EquipmentSlot::HELMET, human.get(), &contentFactory);
+    auto defense = AttrType("DEFENSE");
+    int initial = human->getAttr(defense);
+    // The attribute is cached at this point, the item changes must still show up.
+    helmetPtr->addModifier(defense, 2);
+    CHECKEQ(human->getAttr(defense), initial + 2);
+    helmetPtr->applyPrefix(ItemPrefixes::ItemAttrBonus{defense, 3}, &contentFactory);
+    CHECKEQ(human->getAttr(defense), initial + 5);
+    auto glyph = ItemType(ItemTypes::Glyph{ItemUpgradeInfo{ItemUpgradeType::ARMOR,
+        ItemPrefix(ItemPrefixes::ItemAttrBonus{defense, 4}), none}}).get(&contentFactory);
+    helmetPtr->upgrade(makeVec(std::move(glyph)), &contentFactory);
+    CHECKEQ(human->getAttr(defense), initial + 9);
+  }
+
   void testContainerRange() {
     vector<string> v { "abc", "def", "ghi" };
     int i = 0;
@@ -957,6 +1174,43 @@ class Test {
     CHECK(a == b);
   }
 
+  void testContentIdTable() {
+    vector<FurnitureType> furniture { FurnitureType("TEST_BED"), FurnitureType("TEST_DOOR"), FurnitureType("TEST_BED") };
+    vector<PrimaryId<FurnitureType>> primary { FurnitureType("TEST_DOOR"), FurnitureType("TEST_THRONE") };
+    vector<TechId> techs { TechId("TEST_TECH"), TechId("TEST_TECH") };
+    TextOutput output;
+    {
+      ContentIdTable table(&output.getArchive());
+      output.getArchive() << furniture << primary << techs;
+    }
+    auto text = output.getStream().str();
+    CHECK(text.find("TEST_BED") == text.rfind("TEST_BED")) << text;
+    CHECK(text.find("TEST_DOOR") == text.rfind("TEST_DOOR")) << text;
+    TextInput input(text);
+    vector<FurnitureType> furniture2;
+    vector<PrimaryId<FurnitureType>> primary2;
+    vector<TechId> techs2;
+    {
+      ContentIdTable table(&input.getArchive());
+      input.getArchive() >> furniture2 >> primary2 >> techs2;
+    }
+    CHECK(furniture == furniture2);
+    CHECK(primary == primary2);
+    CHECK(techs == techs2);
+    TextOutput badOutput;
+    badOutput.getArchive() << 5;
+    TextInput badInput(badOutput.getStream().str());
+    ContentIdTable table(&badInput.getArchive());
+    bool thrown = false;
+    try {
+      FurnitureType id("TEST_BED");
+      badInput.getArchive() >> id;
+    } catch (cereal::Exception&) {
+      thrown = true;
+    }
+    CHECK(thrown);
+  }
+
   void testPrettyInput() {
     map<string, TestStruct2> m;
     string text = "{"
@@ -1223,6 +1477,384 @@ class Test {
       t.matching.addTarget(t.get(v.x, v.y));
   }
 
+  struct LevelsTest {
+    LevelsTest() {
+      auto contentFactory = getContentFactory();
+      auto model = Model::create(&contentFactory, none, BiomeId("GRASSLAND"));
+      for (int i : Range(2)) {
+        LevelBuilder builder(nullptr, Random, &contentFactory, 60, 60, false, none);
+        PLevelMaker levelMaker = LevelMaker::emptyLevel(FurnitureType("MOUNTAIN"), true);
+        levels.push_back(model->buildMainLevel(&contentFactory, std::move(builder), std::move(levelMaker)));
+      }
+      game = Game::splashScreen(std::move(model), CampaignBuilder::getEmptyCampaign(), std::move(contentFactory), nullptr);
+    }
+    // Registers the levels with both archives, so that positions are written as references to them
+    // instead of serializing whole levels.
+    void registerLevels(OutputArchive& output, InputArchive& input) {
+      for (auto level : levels)
+        input.registerSharedPointer(output.registerSharedPointer(level),
+            level->getThis().giveMeSharedPointer());
+    }
+    template <typename T, typename U>
+    void roundTrip(const T& from, U& to) {
+      stringstream stream;
+      OutputArchive output(stream);
+      InputArchive input(stream);
+      registerLevels(output, input);
+      output(from);
+      input(to);
+    }
+    vector<Level*> levels;
+    PGame game;
+  };
+
+  void testLevelShortestPathBatch() {
+    LevelsTest t;
+    auto level = t.levels[0];
+    MovementType movement({MovementTrait::WALK});
+    // Open a random cave, so that the paths have to go around the remaining walls.
+    vector<Position> open;
+    for (auto v : Rectangle(5, 5, 55, 55))
+      if (!Random.roll(3)) {
+        Position pos(v, level);
+        pos.removeFurniture(pos.getFurniture(FurnitureLayer::MIDDLE));
+        open.push_back(pos);
+      }
+    vector<LevelShortestPath::Request> requests;
+    for (int i : Range(40))
+      requests.push_back({Random.choose(open), movement, Random.choose(open), i % 4 == 0 ? -1.5 : 0});
+    auto paths = LevelShortestPath::computeAll(requests);
+    CHECKEQ(paths.size(), requests.size());
+    for (int i : All(requests)) {
+      auto& request = requests[i];
+      LevelShortestPath single(request.from, request.movementType, request.to, request.mult);
+      CHECK(paths[i].getPath() == single.getPath()) << i;
+      CHECK(paths[i].isReachable(request.from) == single.isReachable(request.from)) << i;
+    }
+  }
+
+  void testFlowFieldCache() {
+    // A wall splits the area into two rooms, joined by a door at (5, 3).
+    Table<bool> wall(Rectangle(10, 10), false);
+    for (int y : Range(10))
+      wall[Vec2(5, y)] = y != 3;
+    auto entryFun = [&](Vec2 v) { return wall[v] ? ShortestPath::infinity : 1.0; };
+    auto makeField = [&](Vec2 target) {
+      return FlowField(Rectangle(10, 10), target, entryFun, [](Vec2) { return Vec2::directions8(); });
+    };
+    auto field = makeField(Vec2(1, 1));
+    CHECKEQ(field.getDist(Vec2(1, 1)), 0);
+    CHECKEQ(field.getDist(Vec2(4, 4)), 3);
+    CHECK(field.isReachable(Vec2(8, 8)));
+    CHECK(!field.isReachable(Vec2(5, 5)));
+    MovementType movement({MovementTrait::WALK});
+    FlowFieldCache cache;
+    vector<UniqueEntity<Creature>::Id> requesters(3);
+    auto time = 1_local;
+    // Repeated requests from the same creature or anonymous ones don't justify a field.
+    for (int i : Range(5)) {
+      CHECK(!cache.get(Vec2(1, 1), movement, time, requesters[0]));
+      CHECK(!cache.get(Vec2(1, 1), movement, time, none));
+    }
+    CHECK(!cache.needsField(Vec2(1, 1), movement));
+    CHECK(!cache.get(Vec2(1, 1), movement, time, requesters[1]));
+    CHECK(!cache.needsField(Vec2(1, 1), movement));
+    CHECK(!cache.get(Vec2(1, 1), movement, time, requesters[2]));
+    CHECK(cache.needsField(Vec2(1, 1), movement));
+    auto stored = cache.add(Vec2(1, 1), movement, time, makeField(Vec2(1, 1)));
+    CHECK(!cache.needsField(Vec2(1, 1), movement));
+    CHECK(cache.get(Vec2(1, 1), movement, time, none) == stored);
+    // A second field, confined to a room of its own.
+    for (int y : Range(10))
+      wall[Vec2(7, y)] = true;
+    for (auto& requester : requesters)
+      cache.get(Vec2(8, 8), movement, time, requester);
+    auto other = cache.add(Vec2(8, 8), movement, time, makeField(Vec2(8, 8)));
+    CHECK(other->isReachable(Vec2(9, 0)));
+    CHECK(!other->isReachable(Vec2(1, 1)));
+    // Changing a square in the first room affects only the field that reaches it.
+    cache.squareChanged(Vec2(2, 2));
+    CHECK(!cache.get(Vec2(1, 1), movement, time, none));
+    CHECK(cache.needsField(Vec2(1, 1), movement));
+    CHECK(cache.get(Vec2(8, 8), movement, time, none) == other);
+    // So does a wall next to a reachable square, which could have opened a shorter way.
+    cache.squareChanged(Vec2(7, 5));
+    CHECK(!cache.get(Vec2(8, 8), movement, time, none));
+  }
+
+  void testPositionSetGrowth() {
+    LevelsTest t;
+    PositionSet set;
+    HashSet<Position> expected;
+    auto add = [&] (Vec2 v, Level* level) {
+      Position pos(v, level);
+      CHECK(set.insert(pos) == !expected.count(pos)) << v;
+      expected.insert(pos);
+    };
+    auto level = t.levels[0];
+    add(Vec2(30, 30), level);
+    add(Vec2(30, 30), level);
+    // Each insert is outside of the current bounds, in every direction and past the level's edges.
+    for (Vec2 v : {Vec2(0, 30), Vec2(59, 30), Vec2(30, 0), Vec2(30, 59), Vec2(-2, -2), Vec2(61, 61), Vec2(-2, 61),
+        Vec2(61, -2)})
+      add(v, level);
+    for (int i : Range(300))
+      add(Rectangle(60, 60).random(Random), t.levels[Random.get(2)]);
+    CHECK(set.size() == expected.size());
+    for (auto l : t.levels)
+      for (Vec2 v : Rectangle(-5, -5, 65, 65))
+        CHECK(set.contains(Position(v, l)) == expected.count(Position(v, l))) << v;
+  }
+
+  void testPositionSetErase() {
+    LevelsTest t;
+    auto level = t.levels[0];
+    PositionSet set;
+    CHECK(set.empty());
+    CHECK(!set.erase(Position(Vec2(5, 5), level)));
+    set.insert(Position(Vec2(30, 30), level));
+    set.insert(Position(Vec2(31, 30), level));
+    CHECK(set.erase(Position(Vec2(31, 30), level)));
+    CHECK(!set.erase(Position(Vec2(31, 30), level)));
+    CHECK(!set.erase(Position(Vec2(30, 30), t.levels[1])));
+    CHECK(set.size() == 1);
+    set.insert(Position(Vec2(0, 0), level));
+    set.insert(Position(Vec2(59, 59), level));
+    set.insert(Position(Vec2(10, 10), t.levels[1]));
+    CHECK(set.size() == 4);
+    CHECK(set.erase(Position(Vec2(30, 30), level)));
+    CHECK(set.erase(Position(Vec2(59, 59), level)));
+    CHECK(!set.erase(Position(Vec2(100, 100), level)));
+    CHECK(set.size() == 2);
+    CHECK(!set.empty());
+    CHECK(set.contains(Position(Vec2(0, 0), level)));
+    CHECK(!set.contains(Position(Vec2(30, 30), level)));
+    CHECK(set.erase(Position(Vec2(0, 0), level)));
+    CHECK(set.erase(Position(Vec2(10, 10), t.levels[1])));
+    CHECK(set.size() == 0);
+    CHECK(set.empty());
+    CHECK(set.begin() == set.end());
+    for (auto l : t.levels)
+      for (Vec2 v : Rectangle(60, 60))
+        CHECK(!set.contains(Position(v, l)));
+  }
+
+  void testPositionSetIteration() {
+    LevelsTest t;
+    vector<Position> positions;
+    for (int i : Range(200))
+      positions.push_back(Position(Rectangle(-1, -1, 61, 61).random(Random), t.levels[Random.get(2)]));
+    PositionSet set(positions.begin(), positions.end());
+    HashSet<Position> expected(positions.begin(), positions.end());
+    HashSet<Position> visited;
+    optional<Position> previous;
+    HashSet<Level*> finishedLevels;
+    for (auto& pos : set) {
+      CHECK(expected.count(pos) && !visited.count(pos)) << pos.getCoord();
+      visited.insert(pos);
+      // Positions of a level are visited together, ordered by row.
+      if (previous && previous->getLevel() == pos.getLevel())
+        CHECK(make_pair(previous->getCoord().y, previous->getCoord().x) < make_pair(pos.getCoord().y, pos.getCoord().x));
+      if (previous && previous->getLevel() != pos.getLevel())
+        finishedLevels.insert(previous->getLevel());
+      CHECK(!finishedLevels.count(pos.getLevel()));
+      previous = pos;
+    }
+    CHECK(visited.size() == set.size() && set.size() == expected.size());
+    CHECK(set.asVector().size() == set.size());
+    auto shuffled = positions;
+    std::shuffle(shuffled.begin(), shuffled.end(), std::default_random_engine(123));
+    PositionSet set2(shuffled.begin(), shuffled.end());
+    CHECK(set == set2);
+    set2.erase(positions[0]);
+    CHECK(set != set2);
+    Position other(Vec2(100, 100), t.levels[0]);
+    set2.insert(other);
+    CHECK(set2.size() == set.size() && set != set2);
+    set2.erase(other);
+    set2.insert(positions[0]);
+    CHECK(set == set2);
+  }
+
+  void testPositionSetSerialization() {
+    LevelsTest t;
+    PositionSet set;
+    HashSet<Position> legacy;
+    for (int i : Range(300)) {
+      Position pos(Rectangle(-2, -2, 62, 62).random(Random), t.levels[Random.get(2)]);
+      set.insert(pos);
+      legacy.insert(pos);
+    }
+    for (Vec2 v : Rectangle(20, 20, 30, 25))
+      set.insert(Position(v, t.levels[0]));
+    for (Vec2 v : Rectangle(20, 20, 30, 25))
+      legacy.insert(Position(v, t.levels[0]));
+    PositionSet compact;
+    t.roundTrip(set, compact);
+    CHECK(compact == set);
+    CHECK(compact.asVector() == set.asVector());
+    PositionSet fromLegacy;
+    t.roundTrip(legacy, fromLegacy);
+    CHECK(fromLegacy.size() == legacy.size());
+    for (auto& pos : legacy)
+      CHECK(fromLegacy.contains(pos));
+    PositionSet empty;
+    t.roundTrip(PositionSet(), empty);
+    CHECK(empty.empty());
+  }
+
+  // Layout of PositionMap before the compact format.
+  struct LegacyPositionMap {
+    map<LevelId, Table<heap_optional<int>>> tables;
+    map<LevelId, map<Vec2, int>> outliers;
+    SERIALIZE_ALL(tables, outliers)
+  };
+
+  void testPositionMapSerialization() {
+    LevelsTest t;
+    HashMap<Position, int> values;
+    PositionMap<int> positionMap;
+    LegacyPositionMap legacy;
+    auto& legacyTables = legacy.tables;
+    auto& legacyOutliers = legacy.outliers;
+    for (auto level : t.levels)
+      legacyTables.insert(make_pair(level->getUniqueId(), Table<heap_optional<int>>(level->getBounds().minusMargin(-2))));
+    auto add = [&] (Position pos, int value) {
+      values[pos] = value;
+      positionMap.set(pos, value);
+      auto& table = legacyTables.at(pos.getLevel()->getUniqueId());
+      if (pos.getCoord().inRectangle(table.getBounds()))
+        table[pos.getCoord()] = value;
+      else
+        legacyOutliers[pos.getLevel()->getUniqueId()][pos.getCoord()] = value;
+    };
+    for (int i : Range(200))
+      add(Position(Rectangle(-2, -2, 62, 62).random(Random), t.levels[Random.get(2)]), Random.get(1000));
+    add(Position(Vec2(100, 100), t.levels[0]), 5);
+    auto check = [&] (const PositionMap<int>& loaded) {
+      for (auto level : t.levels)
+        for (Vec2 v : Rectangle(-2, -2, 62, 62)) {
+          Position pos(v, level);
+          CHECK(loaded.getValueMaybe(pos) == getValueMaybe(values, pos)) << v;
+        }
+      CHECK(loaded.getValueMaybe(Position(Vec2(100, 100), t.levels[0])) == 5);
+    };
+    PositionMap<int> compact;
+    t.roundTrip(positionMap, compact);
+    check(compact);
+    PositionMap<int> fromLegacy;
+    t.roundTrip(legacy, fromLegacy);
+    check(fromLegacy);
+  }
+
+  void testTileGasSpread() {
+    LevelsTest t;
+    auto level = t.levels[0];
+    auto area = Rectangle(20, 20, 31, 31);
+    for (auto v : area) {
+      Position pos(v, level);
+      pos.removeFurniture(pos.getFurniture(FurnitureLayer::MIDDLE));
+    }
+    auto poison = TileGasType("POISON_GAS");
+    auto getAmount = [&] (Vec2 v) { return Position(v, level).getGasAmount(poison); };
+    auto isNear = [] (double a, double b) { return fabs(a - b) < 0.0001; };
+    Position source(Vec2(25, 25), level);
+    source.addGas(poison, 1);
+    CHECKEQ(source.getGasAmount(poison), 1);
+    // Walls don't take any gas.
+    Position(Vec2(19, 25), level).addGas(poison, 1);
+    CHECKEQ(getAmount(Vec2(19, 25)), 0);
+    level->tick();
+    // Cardinal neighbors take the whole spread, diagonal ones half of it, and the rest decays.
+    CHECK(isNear(getAmount(Vec2(25, 25)), (1 - 4 * 0.1 - 4 * 0.05) * 0.98)) << getAmount(Vec2(25, 25));
+    for (auto dir : Vec2::directions8())
+      CHECK(isNear(getAmount(Vec2(25, 25) + dir), dir.isCardinal4() ? 0.1 : 0.05)) << dir;
+    CHECKEQ(getAmount(Vec2(23, 25)), 0);
+    double lastTotal = 1;
+    for (int i : Range(20)) {
+      level->tick();
+      double total = 0;
+      for (auto v : area)
+        total += getAmount(v);
+      CHECK(total < lastTotal || total == 0) << i;
+      lastTotal = total;
+    }
+    for (auto v : area.minusMargin(-1))
+      if (!v.inRectangle(area))
+        CHECKEQ(getAmount(v), 0);
+  }
+
+  void testTileGasFogCutoff() {
+    LevelsTest t;
+    auto level = t.levels[0];
+    Position pos(Vec2(30, 30), level);
+    pos.removeFurniture(pos.getFurniture(FurnitureLayer::MIDDLE));
+    auto fog = TileGasType("FOG");
+    CHECK(pos.canSeeThru(VisionId::NORMAL));
+    pos.addGas(fog, 1);
+    CHECK(!pos.canSeeThru(VisionId::NORMAL));
+    // Fog doesn't spread and loses 5% per tick, so it stays above the cutoff for 31 ticks.
+    for (int i : Range(31)) {
+      level->tick();
+      CHECK(pos.getGasAmount(fog) >= TileGas::getFogVisionCutoff()) << i;
+      CHECK(!pos.canSeeThru(VisionId::NORMAL)) << i;
+    }
+    level->tick();
+    CHECK(pos.getGasAmount(fog) < TileGas::getFogVisionCutoff());
+    CHECK(pos.canSeeThru(VisionId::NORMAL));
+    CHECKEQ(Position(Vec2(31, 30), level).getGasAmount(fog), 0);
+    // Below 0.1 the remaining gas is cleared at once.
+    for (int i : Range(15))
+      level->tick();
+    CHECKEQ(pos.getGasAmount(fog), 0);
+  }
+
+  // Layout of Square when it stored its own gas.
+  struct LegacyTileGas {
+    TileGas::LegacyAmounts amount;
+    SERIALIZE_ALL(amount)
+  };
+  struct LegacySquare {
+    HeapAllocated<Inventory> inventory;
+    bool onFire = false;
+    Creature* creature = nullptr;
+    optional<StairKey> landingLink;
+    LegacyTileGas tileGas;
+    optional<UniqueEntity<Creature>::Id> lastViewer;
+    unique_ptr<ViewIndex> viewIndex = make_unique<ViewIndex>();
+    optional<TribeId> forbiddenTribe;
+    SERIALIZE_ALL(inventory, onFire, creature, landingLink, tileGas, lastViewer, viewIndex, forbiddenTribe)
+  };
+
+  void testTileGasLegacySquare() {
+    vector<LegacySquare> legacy(3);
+    legacy[0].tileGas.amount[TileGasType("FOG")] = TileGas::AmountInfo{0.5, 0};
+    legacy[0].tileGas.amount[TileGasType("POISON_GAS")] = TileGas::AmountInfo{0.75, 0.25};
+    legacy[2].tileGas.amount[TileGasType("FOG")] = TileGas::AmountInfo{1, 1};
+    legacy[2].onFire = true;
+    stringstream stream;
+    OutputArchive output(stream);
+    InputArchive input(stream);
+    for (auto& square : legacy)
+      output(square);
+    vector<Square> squares(3);
+    for (auto& square : squares)
+      input(square);
+    TileGas gas(Rectangle(10, 10));
+    for (int i : Range(3))
+      squares[i].moveLegacyGas(Vec2(i, 0), gas);
+    CHECKEQ(gas.getAmount(Vec2(0, 0), TileGasType("FOG")), 0.5);
+    CHECKEQ(gas.getAmount(Vec2(0, 0), TileGasType("POISON_GAS")), 0.75);
+    CHECKEQ(gas.getAmount(Vec2(1, 0), TileGasType("FOG")), 0);
+    CHECKEQ(gas.getAmount(Vec2(2, 0), TileGasType("FOG")), 1);
+    CHECK(gas.hasSunlightBlockingAmount(Vec2(2, 0)));
+    CHECK(!gas.hasSunlightBlockingAmount(Vec2(1, 0)));
+    // The legacy amounts are only moved once.
+    TileGas gas2(Rectangle(10, 10));
+    squares[0].moveLegacyGas(Vec2(0, 0), gas2);
+    CHECKEQ(gas2.getAmount(Vec2(0, 0), TileGasType("FOG")), 0);
+  }
+
   void testDungeonLevel() {
     DungeonLevel level;
     CHECKEQ(level.level, 0);
@@ -1298,11 +1930,17 @@ class Test {
 void testAll() {
   Test().testStringConvertion();
   Test().testTimeQueue();
+  Test().testTimeQueueOrder();
   Test().testRectangleIterator();
   Test().testValueCheck();
   Test().testSplit();
   Test().testSplitIncludeDelim();
   Test().testShortestPath();
+  Test().testShortestPathBuckets();
+  Test().testShortestPathParallel();
+  Test().testRunParallelRandom();
+  Test().testLevelShortestPathBatch();
+  Test().testFlowFieldCache();
   Test().testAStar();
   Test().testShortestPath2();
   Test().testShortestPathReverse();
@@ -1326,6 +1964,7 @@ void testAll() {
   Test().testSectors2();
   Test().testSectors3();
   Test().testSectorsWithPortals();
+  Test().testSectorCorridor();
   Test().testReverse();
   Test().testReverse2();
   Test().testReverse3();
@@ -1338,6 +1977,7 @@ void testAll() {
   Test().testMinionEquipmentLocking();
   Test().testEquipmentSlotLocking();
   Test().testMinionEquipment123();
+  Test().testEquippedItemUpgrade();
   Test().testContainerRange();
   Test().testContainerRangeMap();
   Test().testContainerRangeErase();
@@ -1348,10 +1988,19 @@ void testAll() {
   Test().testCacheTemplate();
   Test().testCacheTemplate2();
   Test().testTextSerialization();
+  Test().testContentIdTable();
   Test().testPositionMatching1();
   Test().testPositionMatching2();
   Test().testPositionMatching3();
   Test().testPositionMatching4();
+  Test().testPositionSetGrowth();
+  Test().testPositionSetErase();
+  Test().testPositionSetIteration();
+  Test().testPositionSetSerialization();
+  Test().testPositionMapSerialization();
+  Test().testTileGasSpread();
+  Test().testTileGasFogCutoff();
+  Test().testTileGasLegacySquare();
   Test().testDungeonLevel();
   Test().testPrettyInput();
   Test().testPrettyInput2();
@@ -1374,6 +2023,8 @@ void testAll() {
   Test().testVectorConcat5();
   Test().testVectorConcat6();
   LastingEffects::runTests();
+  FieldOfView::runTests();
+  TileGas::runTests();
   INFO << "-----===== OK =====-----";
 }
 
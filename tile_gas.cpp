@@ -21,71 +21,234 @@
 #include "content_factory.h"
 #include "tile_gas_info.h"
 
-SERIALIZE_DEF(TileGas, amount)
+SERIALIZE_DEF(TileGas, bounds, planes)
+SERIALIZATION_CONSTRUCTOR_IMPL(TileGas)
+
+TileGas::TileGas(Rectangle b) : bounds(b) {
+}
 
 double TileGas::getFogVisionCutoff() {
   return 0.2;
 }
 
+static Rectangle extendBounds(const Rectangle& r, Vec2 v) {
+  if (r.empty())
+    return Rectangle(v, v + Vec2(1, 1));
+  return Rectangle(min(r.left(), v.x), min(r.top(), v.y), max(r.right(), v.x + 1), max(r.bottom(), v.y + 1));
+}
+
+TileGas::Plane& TileGas::getPlane(TileGasType type) {
+  if (auto plane = getReferenceMaybe(planes, type))
+    return *plane;
+  return planes.insert(make_pair(type, Plane(bounds))).first->second;
+}
+
 void TileGas::addAmount(Position pos, TileGasType t, double a) {
   CHECK(a > 0);
-  auto prevValue = amount[t].total;
-  amount[t].total = min(1., a + amount[t].total);
-  if (prevValue < getFogVisionCutoff() && amount[t].total >= getFogVisionCutoff()) {
+  auto& plane = getPlane(t);
+  auto& value = plane.total[pos.getCoord()];
+  auto prevValue = value;
+  value = min(1., a + value);
+  plane.active = extendBounds(plane.active, pos.getCoord());
+  if (prevValue < getFogVisionCutoff() && value >= getFogVisionCutoff()) {
     if (pos.getGame()->getContentFactory()->tileGasTypes.at(t).blocksVision)
       pos.updateVisibility();
     pos.updateConnectivity();
   }
 }
 
-void TileGas::addPermanentAmount(TileGasType t, double a) {
-  auto& values = amount[t];
-  values.total = min(1.0, values.total + a);
-  values.permanent = min(1.0, values.permanent + a);
+void TileGas::addPermanentAmount(Vec2 v, TileGasType t, double a) {
+  auto& plane = getPlane(t);
+  plane.total[v] = min(1.0, plane.total[v] + a);
+  plane.permanent[v] = min(1.0, plane.permanent[v] + a);
+}
+
+void TileGas::addLegacyAmounts(Vec2 v, const LegacyAmounts& amounts) {
+  for (auto& elem : amounts) {
+    auto& plane = getPlane(elem.first);
+    plane.total[v] = elem.second.total;
+    plane.permanent[v] = elem.second.permanent;
+    if (elem.second.total > elem.second.permanent)
+      plane.active = extendBounds(plane.active, v);
+  }
 }
 
-bool TileGas::hasSunlightBlockingAmount() const {
-  for (auto& elem : amount)
-    if (elem.second.total > getFogVisionCutoff())
+bool TileGas::hasSunlightBlockingAmount(Vec2 v) const {
+  for (auto& elem : planes)
+    if (elem.second.total[v] > getFogVisionCutoff())
       return true;
   return false;
 }
 
-void TileGas::tick(Position pos) {
+double TileGas::getAmount(Vec2 v, TileGasType type) const {
+  if (auto plane = getReferenceMaybe(planes, type))
+    return plane->total[v];
+  return 0;
+}
+
+void TileGas::updateReceiving(Position pos) {
+  if (!receiving.getBounds().empty())
+    receiving[pos.getCoord()] = pos.canSeeThruIgnoringGas(VisionId::NORMAL) ? 1 : 0;
+}
+
+void TileGas::tick(Level* level) {
   PROFILE;
-  for (auto& elem : amount) {
-    auto& value = elem.second;
-    auto prevValue = value.total;
-    auto& info = pos.getGame()->getContentFactory()->tileGasTypes.at(elem.first);
-    if (info.effect && value.total > 0.01 && Random.chance(value.total))
-      info.effect->apply(pos);
-    if (value.total - value.permanent < 0.1)
-      value.total = value.permanent;
-    else {
-      if (info.spread > 0)
-        for (Position v : pos.neighbors8(Random)) {
-          if (v.canSeeThruIgnoringGas(VisionId::NORMAL) && value.total - value.permanent > 0 &&
-              v.getGasAmount(elem.first) < value.total) {
-            double transfer = pos.getDir(v).isCardinal4() ? info.spread : info.spread / 2;
-            transfer = min(value.total - value.permanent, transfer);
-            transfer = min((value.total - v.getGasAmount(elem.first)) / 2, transfer);
-            value.total -= transfer;
-            CHECK(value.total >= value.permanent);
-            v.addGas(elem.first, transfer);
-          }
-        }
-      value.total = max(value.permanent, value.permanent + (value.total - value.permanent) * info.decrease);
-    }
-    if (prevValue >= getFogVisionCutoff() && value.total < getFogVisionCutoff()) {
+  if (receiving.getBounds().empty()) {
+    receiving = Table<float>(bounds, 0);
+    for (auto v : bounds)
+      updateReceiving(Position(v, level));
+  }
+  // Effects can add other gas types, which would invalidate the iterators.
+  for (auto type : getKeys(planes)) {
+    auto& plane = planes.at(type);
+    if (!plane.active.empty())
+      tick(level, type, plane);
+  }
+}
+
+void TileGas::tick(Level* level, TileGasType type, Plane& plane) {
+  auto& info = level->getGame()->getContentFactory()->tileGasTypes.at(type);
+  if (info.effect) {
+    auto effectArea = plane.active;
+    for (auto v : effectArea)
+      if (plane.total[v] > 0.01 && Random.chance(plane.total[v]))
+        info.effect->apply(Position(v, level));
+  }
+  auto onChange = [&] (Vec2 v, bool crossedCutoff) {
+    Position pos(v, level);
+    pos.setNeedsRenderAndMemoryUpdate(true);
+    if (crossedCutoff) {
       if (info.blocksVision)
         pos.updateVisibility();
       pos.updateConnectivity();
     }
+  };
+  spread(plane, info.spread, info.decrease, Random.permutation(Vec2::directions8()), onChange);
+}
+
+// Spreading is computed from the amounts at the start of the tick, one direction at a time,
+// so that the inner loops run over contiguous columns of the planes. Like when the squares were processed
+// one by one, a square gives less to the neighbors that come later, so the order of the directions
+// is shuffled every tick.
+template <typename OnChange>
+void TileGas::spread(Plane& plane, float spread, float decrease, const vector<Vec2>& directions,
+    OnChange onChange) {
+  const auto active = plane.active;
+  const auto region = Rectangle(active.left() - 1, active.top() - 1, active.right() + 1, active.bottom() + 1)
+      .intersection(bounds);
+  if (plane.current.getBounds().empty()) {
+    plane.current = Table<float>(bounds, 0);
+    plane.incoming = Table<float>(bounds, 0);
+    plane.aboveMinimum = Table<float>(bounds, 0);
   }
+  for (int x = region.left(); x < region.right(); ++x) {
+    const int y0 = region.top();
+    const float* total = &plane.total[x][y0];
+    const float* permanent = &plane.permanent[x][y0];
+    float* current = &plane.current[x][y0];
+    float* incoming = &plane.incoming[x][y0];
+    float* aboveMinimum = &plane.aboveMinimum[x][y0];
+    for (int i = 0; i < region.height(); ++i) {
+      current[i] = total[i];
+      incoming[i] = 0;
+      aboveMinimum[i] = total[i] - permanent[i] >= 0.1 ? 1 : 0;
+    }
+  }
+  if (spread > 0)
+    for (auto dir : directions) {
+      const float maxTransfer = dir.isCardinal4() ? spread : spread / 2;
+      auto sources = active.intersection(bounds.translate(-dir));
+      for (int x = sources.left(); x < sources.right(); ++x) {
+        const int y0 = sources.top();
+        float* src = &plane.current[x][y0];
+        float* dest = &plane.incoming[x + dir.x][y0 + dir.y];
+        const float* destTotal = &plane.total[x + dir.x][y0 + dir.y];
+        const float* destOpen = &receiving[x + dir.x][y0 + dir.y];
+        const float* srcPermanent = &plane.permanent[x][y0];
+        const float* srcAboveMinimum = &plane.aboveMinimum[x][y0];
+        for (int i = 0; i < sources.height(); ++i) {
+          float transfer = min(maxTransfer, min(src[i] - srcPermanent[i], (src[i] - destTotal[i]) / 2));
+          transfer = max(0.0f, transfer) * destOpen[i] * srcAboveMinimum[i];
+          src[i] -= transfer;
+          dest[i] += transfer;
+        }
+      }
+    }
+  Rectangle newActive;
+  for (int x = region.left(); x < region.right(); ++x) {
+    const int y0 = region.top();
+    const bool activeColumn = x >= active.left() && x < active.right();
+    float* total = &plane.total[x][y0];
+    const float* permanent = &plane.permanent[x][y0];
+    const float* src = &plane.current[x][y0];
+    const float* in = &plane.incoming[x][y0];
+    const float* decays = &plane.aboveMinimum[x][y0];
+    for (int i = 0; i < region.height(); ++i) {
+      const int y = y0 + i;
+      float value = src[i];
+      if (activeColumn && y >= active.top() && y < active.bottom())
+        value = decays[i] > 0 ? max(permanent[i], permanent[i] + (value - permanent[i]) * decrease)
+            : permanent[i];
+      value = min(1.0f, value + in[i]);
+      if (value != total[i]) {
+        const bool crossedCutoff = (total[i] >= getFogVisionCutoff()) != (value >= getFogVisionCutoff());
+        total[i] = value;
+        onChange(Vec2(x, y), crossedCutoff);
+      }
+      if (total[i] > permanent[i])
+        newActive = extendBounds(newActive, Vec2(x, y));
+    }
+  }
+  plane.active = newActive;
 }
 
-double TileGas::getAmount(TileGasType type) const {
-  if (auto res = getReferenceMaybe(amount, type))
-    return res->total;
-  return 0;
+// Pins the distribution of the simultaneous spread over a few ticks.
+void TileGas::runTests() {
+  TileGas gas(Rectangle(11, 11));
+  gas.receiving = Table<float>(gas.bounds, 1);
+  gas.receiving[Vec2(5, 3)] = 0;
+  auto type = TileGasType("POISON_GAS");
+  auto& plane = gas.getPlane(type);
+  plane.total[Vec2(5, 5)] = 1;
+  plane.active = extendBounds(plane.active, Vec2(5, 5));
+  auto isNear = [] (double a, double b) { return fabs(a - b) < 0.00001; };
+  vector<Vec2> changed;
+  auto tick = [&] {
+    changed.clear();
+    gas.spread(plane, 0.1, 0.98, Vec2::directions8(), [&] (Vec2 v, bool) { changed.push_back(v); });
+  };
+  tick();
+  CHECK(isNear(plane.total[Vec2(5, 5)], 0.4 * 0.98)) << plane.total[Vec2(5, 5)];
+  for (auto dir : Vec2::directions8())
+    CHECK(isNear(plane.total[Vec2(5, 5) + dir], dir.isCardinal4() ? 0.1 : 0.05)) << dir;
+  CHECKEQ(changed.size(), 9);
+  CHECKEQ(plane.active, Rectangle(4, 4, 7, 7));
+  // In the second tick the squares next to the source have already given most of their gas
+  // to the neighbors that come first in the order of the directions.
+  tick();
+  for (auto elem : {
+      make_pair(Vec2(5, 5), 0.0535325),
+      make_pair(Vec2(5, 4), 0.1153125),
+      make_pair(Vec2(5, 6), 0.1082499),
+      make_pair(Vec2(4, 5), 0.0316562),
+      make_pair(Vec2(6, 5), 0.0556562),
+      make_pair(Vec2(4, 4), 0.056),
+      make_pair(Vec2(6, 4), 0.087),
+      make_pair(Vec2(4, 6), 0.017125),
+      make_pair(Vec2(6, 6), 0.02175),
+      make_pair(Vec2(3, 5), 0.03125),
+      make_pair(Vec2(5, 7), 0.05),
+      make_pair(Vec2(6, 3), 0.03125),
+      make_pair(Vec2(5, 3), 0.0)})
+    CHECK(isNear(plane.total[elem.first], elem.second)) << elem.first << " " << plane.total[elem.first];
+  double total = 0;
+  for (int i : Range(30)) {
+    tick();
+    double newTotal = 0;
+    for (auto v : gas.bounds)
+      newTotal += plane.total[v];
+    CHECK(i == 0 || newTotal < total || newTotal == 0) << i;
+    total = newTotal;
+  }
+  CHECKEQ(plane.total[Vec2(5, 3)], 0);
 }
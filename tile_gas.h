@@ -21,23 +21,51 @@
 
 class Level;
 
+// Gas amounts for a whole level, stored as one dense plane per gas type. Only the bounding box of squares
+// that have gas above their permanent amount is ticked.
 class TileGas {
   public:
+  TileGas(Rectangle bounds);
   void addAmount(Position, TileGasType, double amount);
-  void addPermanentAmount(TileGasType, double amount);
-  void tick(Position);
-  double getAmount(TileGasType) const;
+  void addPermanentAmount(Vec2, TileGasType, double amount);
+  void tick(Level*);
+  double getAmount(Vec2, TileGasType) const;
   static double getFogVisionCutoff();
-  bool hasSunlightBlockingAmount() const;
+  bool hasSunlightBlockingAmount(Vec2) const;
+  // Called when the vision through the square changes, gas only spreads into squares that can be seen through.
+  void updateReceiving(Position);
+  static void runTests();
 
-  template <class Archive>
-  void serialize(Archive& ar, const unsigned int version);
-
-  private:
   struct AmountInfo {
     double SERIAL(total);
     double SERIAL(permanent);
     SERIALIZE_ALL(total, permanent)
   };
-  HashMap<TileGasType, AmountInfo> SERIAL(amount);
+  // Gas used to be stored in every Square, this is only used to load such saves.
+  using LegacyAmounts = HashMap<TileGasType, AmountInfo>;
+  void addLegacyAmounts(Vec2, const LegacyAmounts&);
+
+  SERIALIZATION_DECL(TileGas)
+
+  private:
+  struct Plane {
+    Plane(Rectangle bounds) : total(bounds, 0), permanent(bounds, 0) {}
+    Table<float> SERIAL(total);
+    Table<float> SERIAL(permanent);
+    Rectangle SERIAL(active);
+    SERIALIZE_ALL(total, permanent, active)
+    SERIALIZATION_CONSTRUCTOR(Plane)
+    // Scratch space for spreading, allocated the first time the plane is ticked.
+    Table<float> current;
+    Table<float> incoming;
+    Table<float> aboveMinimum;
+  };
+  Plane& getPlane(TileGasType);
+  void tick(Level*, TileGasType, Plane&);
+  template <typename OnChange>
+  void spread(Plane&, float spread, float decrease, const vector<Vec2>& directions, OnChange);
+  Rectangle SERIAL(bounds);
+  HashMap<TileGasType, Plane> SERIAL(planes);
+  // 1 for squares that can take gas, built on the first tick.
+  Table<float> receiving;
 };
@@ -21,132 +21,287 @@
 
 template <class Archive> 
 void TimeQueue::serialize(Archive& ar, const unsigned int version) { 
+  EntityMap<Creature, ExtendedTime> timeMap;
+  map<ExtendedTime, Queue> queue;
+  if (Archive::is_saving::value) {
+    for (auto& c : creatures)
+      timeMap.set(c.get(), getExtendedTime(getEntry(c.get()).key));
+    // Only buckets with live slots are written, plus the current one so that loading restores the calendar base.
+    auto addQueue = [&] (int key, const Bucket& bucket) {
+      Queue q;
+      auto addSlots = [&] (const SlotList& list, deque<Creature*>& to) {
+        for (int i = list.begin; i < list.slots.size(); ++i)
+          if (isValid(list.slots[i], key)) {
+            to.push_back(list.slots[i].creature);
+            q.orderMap.set(list.slots[i].creature, list.slots[i].order);
+          }
+      };
+      addSlots(bucket.players, q.players);
+      addSlots(bucket.nonPlayers, q.nonPlayers);
+      if (!q.players.empty() || !q.nonPlayers.empty() || key == baseKey)
+        queue[getExtendedTime(key)] = std::move(q);
+    };
+    if (!calendar.empty())
+      for (int key = baseKey; key < baseKey + calendarSize; ++key)
+        addQueue(key, calendar[key & (calendarSize - 1)]);
+    for (auto& elem : overflow)
+      addQueue(elem.first, elem.second);
+  }
   ar(creatures, timeMap, queue);
+  if (Archive::is_loading::value) {
+    entries.clear();
+    for (int i : All(creatures)) {
+      auto c = creatures[i].get();
+      c->timeQueueIndex = i;
+      auto time = timeMap.getOrFail(c);
+      entries.push_back(Entry{getKey(time), queue.at(time).orderMap.getOrFail(c)});
+    }
+    calendar.clear();
+    overflow.clear();
+    if (!queue.empty())
+      setCalendarBase(getKey(queue.begin()->first));
+    for (auto& elem : queue) {
+      auto& bucket = getBucket(getKey(elem.first));
+      for (auto c : elem.second.players)
+        if (c)
+          bucket.players.slots.push_back(Slot{c, elem.second.orderMap.getOrFail(c)});
+      for (auto c : elem.second.nonPlayers)
+        if (c)
+          bucket.nonPlayers.slots.push_back(Slot{c, elem.second.orderMap.getOrFail(c)});
+    }
+  }
 }
 
 SERIALIZABLE(TimeQueue);
 
 void TimeQueue::addCreature(PCreature c, LocalTime time) {
-  timeMap.set(c.get(), time);
-  queue[time].push(c.get());
+  auto ref = c.get();
+  ref->timeQueueIndex = creatures.size();
+  entries.push_back(Entry{noKey, 0});
   creatures.push_back(std::move(c));
+  push(ref, getKey(time));
 }
 
 LocalTime TimeQueue::getTime(const Creature* c) {
-  return timeMap.getOrFail(c).time;
+  return getExtendedTime(getEntry(c).key).time;
+}
+
+TimeQueue::Entry& TimeQueue::getEntry(const Creature* c) {
+  CHECK(c->timeQueueIndex >= 0 && c->timeQueueIndex < entries.size() &&
+      creatures[c->timeQueueIndex].get() == c) << "Creature not in queue " << c->identify();
+  return entries[c->timeQueueIndex];
+}
+
+const TimeQueue::Entry& TimeQueue::getEntry(const Creature* c) const {
+  return const_cast<TimeQueue*>(this)->getEntry(c);
+}
+
+bool TimeQueue::SlotList::empty() const {
+  return begin == slots.size();
+}
+
+TimeQueue::Slot& TimeQueue::SlotList::front() {
+  return slots[begin];
+}
+
+TimeQueue::Slot& TimeQueue::SlotList::back() {
+  return slots.back();
+}
+
+void TimeQueue::SlotList::pushFront(Slot slot) {
+  if (begin > 0)
+    slots[--begin] = slot;
+  else
+    slots.push_front(slot);
+}
+
+bool TimeQueue::Bucket::isClear() const {
+  return players.slots.empty() && nonPlayers.slots.empty();
+}
+
+void TimeQueue::Bucket::clear() {
+  for (auto list : {&players, &nonPlayers}) {
+    list->slots.clear();
+    list->begin = 0;
+  }
+}
+
+int TimeQueue::getKey(ExtendedTime time) {
+  return time.time.getInternal() * 2 + (time.extraTurn ? 1 : 0);
+}
+
+TimeQueue::ExtendedTime TimeQueue::getExtendedTime(int key) {
+  ExtendedTime ret(LocalTime(key >> 1));
+  ret.extraTurn = (key & 1);
+  return ret;
 }
 
-static void clearNull(deque<Creature*>& q) {
-  while (!q.empty() && q.back() == nullptr)
-    q.pop_back();
-  while (!q.empty() && q.front() == nullptr)
-    q.pop_front();
+void TimeQueue::setCalendarBase(int key) {
+  if (calendar.empty())
+    calendar.resize(calendarSize);
+  else
+    for (int k = baseKey; k < baseKey + calendarSize; ++k) {
+      auto& bucket = calendar[k & (calendarSize - 1)];
+      if (!bucket.isClear())
+        overflow[k] = std::move(bucket);
+      bucket = Bucket();
+    }
+  baseKey = key;
+  while (!overflow.empty() && overflow.begin()->first < baseKey + calendarSize) {
+    CHECK(overflow.begin()->first >= baseKey);
+    calendar[overflow.begin()->first & (calendarSize - 1)] = std::move(overflow.begin()->second);
+    overflow.erase(overflow.begin());
+  }
+}
+
+void TimeQueue::advanceCalendar() {
+  calendar[baseKey & (calendarSize - 1)].clear();
+  ++baseKey;
+  int lastKey = baseKey + calendarSize - 1;
+  if (!overflow.empty() && overflow.begin()->first == lastKey) {
+    calendar[lastKey & (calendarSize - 1)] = std::move(overflow.begin()->second);
+    overflow.erase(overflow.begin());
+  }
+}
+
+TimeQueue::Bucket& TimeQueue::getBucket(int key) {
+  if (calendar.empty() || key < baseKey)
+    setCalendarBase(key);
+  if (key - baseKey < calendarSize)
+    return calendar[key & (calendarSize - 1)];
+  return overflow[key];
 }
 
-void TimeQueue::Queue::clearNull() {
-  ::clearNull(players);
-  ::clearNull(nonPlayers);
+TimeQueue::Bucket* TimeQueue::getBucketIfExists(int key) {
+  if (calendar.empty() || key < baseKey)
+    return nullptr;
+  if (key - baseKey < calendarSize)
+    return &calendar[key & (calendarSize - 1)];
+  if (auto bucket = getReferenceMaybe(overflow, key))
+    return &*bucket;
+  return nullptr;
 }
 
-void TimeQueue::Queue::push(Creature* c) {
-  clearNull();
+bool TimeQueue::isValid(const Slot& slot, int key) const {
+  if (!slot.creature)
+    return false;
+  auto& entry = getEntry(slot.creature);
+  return entry.key == key && entry.order == slot.order;
+}
+
+void TimeQueue::clearStale(SlotList& list, int key) {
+  while (!list.empty() && !isValid(list.back(), key))
+    list.slots.pop_back();
+  while (!list.empty() && !isValid(list.front(), key))
+    ++list.begin;
+  if (list.empty())
+    list.slots.clear();
+  if (list.slots.empty())
+    list.begin = 0;
+}
+
+void TimeQueue::push(Creature* c, int key) {
+  auto& bucket = getBucket(key);
+  clearStale(bucket.players, key);
+  clearStale(bucket.nonPlayers, key);
+  auto& entry = getEntry(c);
+  entry.key = key;
   if (c->isPlayer()) {
-    int order = players.empty() ? 0 : orderMap.getOrFail(players.back()) + 1;
-    orderMap.set(c, order);
-    players.push_back(c);
+    entry.order = bucket.players.empty() ? 0 : bucket.players.back().order + 1;
+    bucket.players.slots.push_back(Slot{c, entry.order});
   } else {
-    int order = nonPlayers.empty() ? 1000000000 : orderMap.getOrFail(nonPlayers.back()) + 1;
-    orderMap.set(c, order);
-    nonPlayers.push_back(c);
+    entry.order = bucket.nonPlayers.empty() ? 1000000000 : bucket.nonPlayers.back().order + 1;
+    bucket.nonPlayers.slots.push_back(Slot{c, entry.order});
   }
 }
 
-void TimeQueue::Queue::pushFront(Creature* c) {
-  clearNull();
+void TimeQueue::pushFront(Creature* c, int key) {
+  auto& bucket = getBucket(key);
+  clearStale(bucket.players, key);
+  clearStale(bucket.nonPlayers, key);
+  auto& entry = getEntry(c);
+  entry.key = key;
   if (c->isPlayer()) {
-    int order = players.empty() ? 0 : orderMap.getOrFail(players.front()) - 1;
-    orderMap.set(c, order);
-    players.push_front(c);
+    entry.order = bucket.players.empty() ? 0 : bucket.players.front().order - 1;
+    bucket.players.pushFront(Slot{c, entry.order});
   } else {
-    int order = nonPlayers.empty() ? 1000000000 : orderMap.getOrFail(nonPlayers.front()) - 1;
-    orderMap.set(c, order);
-    nonPlayers.push_front(c);
+    entry.order = bucket.nonPlayers.empty() ? 1000000000 : bucket.nonPlayers.front().order - 1;
+    bucket.nonPlayers.pushFront(Slot{c, entry.order});
   }
 }
 
-bool TimeQueue::Queue::empty() {
-  clearNull();
-  return players.empty() && nonPlayers.empty();
+bool TimeQueue::isCalendarEmpty() {
+  for (int key = baseKey; key < baseKey + calendarSize; ++key)
+    if (!isEmpty(key))
+      return false;
+  return true;
 }
 
-Creature* TimeQueue::Queue::front() {
-  clearNull();
-  if (!players.empty())
-    return players.front();
-  else
-    return nonPlayers.front();
+bool TimeQueue::isEmpty(int key) {
+  if (auto bucket = getBucketIfExists(key)) {
+    clearStale(bucket->players, key);
+    clearStale(bucket->nonPlayers, key);
+    return bucket->players.empty() && bucket->nonPlayers.empty();
+  }
+  return true;
 }
 
-void TimeQueue::Queue::popFront() {
-  if (!players.empty())
-    return players.pop_front();
+Creature* TimeQueue::getFront(int key) {
+  CHECK(!isEmpty(key));
+  auto& bucket = *getBucketIfExists(key);
+  if (!bucket.players.empty())
+    return bucket.players.front().creature;
   else
-    return nonPlayers.pop_front();
+    return bucket.nonPlayers.front().creature;
 }
 
-void TimeQueue::Queue::erase(Creature* c) {
-  auto eraseFrom = [&c] (deque<Creature*>& queue) {
-    for (int i : All(queue))
-      if (queue[i] == c) {
-        queue[i] = nullptr;
-        return true;
-      }
-    return false;
-  };
-  CHECK(eraseFrom(players) || eraseFrom(nonPlayers));
+// The creature's slot goes stale and is skipped once it reaches either end of its bucket.
+void TimeQueue::erase(Creature* c) {
+  getEntry(c).key = noKey;
 }
 
 void TimeQueue::increaseTime(Creature* c, TimeInterval diff) {
-  auto& time = timeMap.getOrFail(c);
-  queue.at(time).erase(c);
+  auto time = getExtendedTime(getEntry(c).key);
+  erase(c);
   time.time += diff;
   time.extraTurn = false;
-  queue[time].push(c);
+  push(c, getKey(time));
 }
 
 void TimeQueue::makeExtraMove(Creature* c) {
-  auto& time = timeMap.getOrFail(c);
-  queue.at(time).erase(c);
+  auto time = getExtendedTime(getEntry(c).key);
+  erase(c);
   if (!time.extraTurn)
     time.extraTurn = true;
   else {
     time.time += 1_visible;
     time.extraTurn = false;
   }
-  queue[time].push(c);
+  push(c, getKey(time));
 }
 
 bool TimeQueue::hasExtraMove(Creature* c) {
-  return timeMap.getOrFail(c).extraTurn;
+  return getExtendedTime(getEntry(c).key).extraTurn;
 }
 
 void TimeQueue::postponeMove(Creature* c) {
   CHECK(contains(c));
-  auto time = timeMap.getOrFail(c);
-  queue.at(time).erase(c);
-  queue.at(time).push(c);
+  auto key = getEntry(c).key;
+  erase(c);
+  push(c, key);
 }
 
 void TimeQueue::moveNow(Creature* c) {
   CHECK(contains(c));
-  auto time = timeMap.getOrFail(c);
-  queue.at(time).erase(c);
-  queue.at(time).pushFront(c);
+  auto key = getEntry(c).key;
+  erase(c);
+  pushFront(c, key);
 }
 
 bool TimeQueue::willMoveThisTurn(const Creature* c) {
-  auto hisTime = timeMap.getOrFail(c);
-  auto curTime = queue.begin()->first;
+  CHECK(!calendar.empty());
+  auto hisTime = getExtendedTime(getEntry(c).key);
+  auto curTime = getExtendedTime(baseKey);
   return hisTime.time == curTime.time && (!hisTime.extraTurn || curTime.extraTurn);
 }
 
@@ -157,35 +312,42 @@ bool TimeQueue::compareOrder(const Creature* c1, const Creature* c2) {
     return false;
   if (!willMoveThisTurn(c1))
     return c1->getLastMoveCounter() < c2->getLastMoveCounter();
-  auto time1 = timeMap.getOrFail(c1);
-  auto time2 = timeMap.getOrFail(c2);
-  if (time1 < time2)
-    return true;
-  if (time2 < time1)
-    return false;
-  auto& orderMap = queue.at(time1).orderMap;
-  return orderMap.getOrFail(c1) < orderMap.getOrFail(c2);
+  auto& entry1 = getEntry(c1);
+  auto& entry2 = getEntry(c2);
+  if (entry1.key != entry2.key)
+    return entry1.key < entry2.key;
+  return entry1.order < entry2.order;
 }
 
 bool TimeQueue::contains(Creature* c) const {
-  for (auto& creature : creatures)
-    if (creature.get() == c)
-      return true;
-  return false;
+  return c->timeQueueIndex >= 0 && c->timeQueueIndex < creatures.size() &&
+      creatures[c->timeQueueIndex].get() == c;
 }
 
 TimeQueue::TimeQueue() {}
 
 PCreature TimeQueue::removeCreature(Creature* cRef) {
-  for (int i : All(creatures))
-    if (creatures[i].get() == cRef) {
-      queue.at(timeMap.getOrFail(cRef)).erase(cRef);
-      PCreature ret = std::move(creatures[i]);
-      creatures.removeIndexPreserveOrder(i);
-      return ret;
-    }
-  FATAL << "Creature not found " << cRef->identify();
-  return nullptr;
+  if (!contains(cRef))
+    FATAL << "Creature not found " << cRef->identify();
+  // Removed creatures may be destroyed, so none of their slots can be left to go stale.
+  auto clearSlots = [cRef] (Bucket& bucket) {
+    for (auto list : {&bucket.players, &bucket.nonPlayers})
+      for (auto& slot : list->slots)
+        if (slot.creature == cRef)
+          slot.creature = nullptr;
+  };
+  for (auto& bucket : calendar)
+    clearSlots(bucket);
+  for (auto& elem : overflow)
+    clearSlots(elem.second);
+  int index = cRef->timeQueueIndex;
+  PCreature ret = std::move(creatures[index]);
+  creatures.removeIndexPreserveOrder(index);
+  entries.removeIndexPreserveOrder(index);
+  for (int i = index; i < creatures.size(); ++i)
+    creatures[i]->timeQueueIndex = i;
+  ret->timeQueueIndex = -1;
+  return ret;
 }
 
 vector<Creature*> TimeQueue::getAllCreatures() const {
@@ -195,24 +357,21 @@ vector<Creature*> TimeQueue::getAllCreatures() const {
 Creature* TimeQueue::getNextCreature(double maxTime) {
   if (creatures.empty())
     return nullptr;
-  while (1) {
-    CHECK(!queue.empty());
-    if (!queue.begin()->second.empty())
-      break;
-    queue.erase(queue.begin());
-  }
-  auto nowTime = queue.begin()->first;
+  for (int steps = 1; isEmpty(baseKey); ++steps)
+    if (steps % calendarSize == 0 && isCalendarEmpty()) {
+      CHECK(!overflow.empty());
+      setCalendarBase(overflow.begin()->first);
+    } else
+      advanceCalendar();
+  auto nowTime = getExtendedTime(baseKey);
   if (nowTime.getDouble() > maxTime)
     return nullptr;
-  auto& q = queue.begin()->second;
-  if (!nowTime.extraTurn) {
-    auto nextQueue = ++queue.begin();
-    if (nextQueue != queue.end()) {
-      if (nextQueue->first.time == nowTime.time && !nextQueue->second.empty() && nextQueue->second.front()->isPlayer())
-        return nextQueue->second.front();
-    }
+  if (!nowTime.extraTurn && !isEmpty(baseKey + 1)) {
+    auto next = getFront(baseKey + 1);
+    if (next->isPlayer())
+      return next;
   }
-  return q.front();
+  return getFront(baseKey);
 }
 
 TimeQueue::ExtendedTime::ExtendedTime() {}
@@ -45,21 +45,60 @@ class TimeQueue {
   private:
   bool contains(Creature*) const;
 
-  vector<PCreature> SERIAL(creatures);
+  vector<PCreature> creatures;
+  // Creatures are scheduled in a calendar of buckets, one per half-turn: key = 2 * time + extraTurn.
+  // Keys beyond the calendar window wait in the overflow map.
+  static constexpr int calendarSize = 64;
+  static constexpr int noKey = std::numeric_limits<int>::min();
+  // Scheduling state of each creature, indexed by Creature::timeQueueIndex.
+  struct Entry {
+    int key;
+    int order;
+  };
+  vector<Entry> entries;
+  // Slots of creatures that were rescheduled go stale and are skipped lazily.
+  struct Slot {
+    Creature* creature;
+    int order;
+  };
+  struct SlotList {
+    vector<Slot> slots;
+    int begin = 0;
+    bool empty() const;
+    Slot& front();
+    Slot& back();
+    void pushFront(Slot);
+  };
+  struct Bucket {
+    SlotList players;
+    SlotList nonPlayers;
+    bool isClear() const;
+    void clear();
+  };
+  vector<Bucket> calendar;
+  map<int, Bucket> overflow;
+  int baseKey = 0;
+  Bucket& getBucket(int key);
+  Bucket* getBucketIfExists(int key);
+  void setCalendarBase(int key);
+  void advanceCalendar();
+  bool isValid(const Slot&, int key) const;
+  void clearStale(SlotList&, int key);
+  bool isEmpty(int key);
+  bool isCalendarEmpty();
+  Creature* getFront(int key);
+  void push(Creature*, int key);
+  void pushFront(Creature*, int key);
+  void erase(Creature*);
+  Entry& getEntry(const Creature*);
+  const Entry& getEntry(const Creature*) const;
+
+  // Save format, converted to and from the calendar on serialization.
   struct Queue {
-    void push(Creature*);
-    void pushFront(Creature*);
-    bool empty();
-    Creature* front();
-    void popFront();
-    void erase(Creature*);
     deque<Creature*> SERIAL(players);
     deque<Creature*> SERIAL(nonPlayers);
     EntityMap<Creature, int> SERIAL(orderMap);
     SERIALIZE_ALL(players, nonPlayers, orderMap)
-
-    private:
-    void clearNull();
   };
   struct ExtendedTime {
     ExtendedTime();
@@ -70,7 +109,6 @@ class TimeQueue {
     bool SERIAL(extraTurn) = false;
     SERIALIZE_ALL(time, extraTurn)
   };
-  map<ExtendedTime, Queue> SERIAL(queue);
-  EntityMap<Creature, ExtendedTime> SERIAL(timeMap);
+  static int getKey(ExtendedTime);
+  static ExtendedTime getExtendedTime(int key);
 };
-
@@ -23,9 +23,27 @@ RandomGen::RandomGen() {
   PROFILE;
 }
 
-void RandomGen::init(int seed) {
+void RandomGen::init(int s) {
   PROFILE;
-  generator.seed(seed);
+  generator.seed(s);
+  seed = (unsigned) s;
+  numChildren = 0;
+}
+
+int RandomGen::getChildSeed() {
+  unsigned long long x = seed + 0x9e3779b97f4a7c15ULL * ++numChildren;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return int(x ^ (x >> 31));
+}
+
+RandomGen::State RandomGen::getState() const {
+  return State{generator, defaultDist};
+}
+
+void RandomGen::setState(const State& state) {
+  generator = state.generator;
+  defaultDist = state.defaultDist;
 }
 
 int RandomGen::get(int max) {
@@ -114,7 +132,7 @@ float RandomGen::getFloatFast(float a, float b) {
   return a + (b - a) * float(v) * (1.0f / float(INT_MAX - 1));
 }
 
-RandomGen Random;
+thread_local RandomGen Random;
 
 template string toString<int>(const int&);
 template string toString<unsigned int>(const unsigned int&);
@@ -1015,14 +1033,119 @@ thread makeThread(function<void()> fun) {
 
 #else*/
 
+// The thread local Random of a new thread is seeded from the spawning thread's Random, so seeded runs
+// are reproducible, without advancing the spawning thread's sequence.
 thread makeThread(function<void()> fun) {
-  return thread(fun);
+  int seed = Random.getChildSeed();
+  return thread([fun, seed] {
+    Random.init(seed);
+    fun();
+  });
 }
 
 scoped_thread makeScopedThread(function<void()> fun) {
   return scoped_thread(makeThread(std::move(fun)));
 }
 
+namespace {
+// Threads that are kept alive between calls to runParallel, so that their thread_local scratch data,
+// like the path search tables, is only allocated once.
+class WorkerPool {
+  public:
+  static WorkerPool& get() {
+    static WorkerPool pool;
+    return pool;
+  }
+
+  static bool isWorkerThread() {
+    return workerThread;
+  }
+
+  // Runs the jobs on numThreads pool threads. Returns false without running anything if the pool is busy.
+  bool tryRun(int numJobs, const function<void(int)>& fun, int numThreads) {
+    std::unique_lock<std::mutex> runLock(runMutex, std::try_to_lock);
+    if (!runLock.owns_lock())
+      return false;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (threads.size() < numThreads)
+      threads.push_back(makeThread([this] { work(); }));
+    job = &fun;
+    numJobsTotal = numJobs;
+    nextJob = 0;
+    numWorkers = numThreads;
+    numJoined = 0;
+    numFinished = 0;
+    ++batch;
+    wakeUp.notify_all();
+    done.wait(lock, [&] { return numFinished == numWorkers; });
+    job = nullptr;
+    return true;
+  }
+
+  ~WorkerPool() {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wakeUp.notify_all();
+    for (auto& t : threads)
+      t.join();
+  }
+
+  private:
+  void work() {
+    workerThread = true;
+    int lastBatch = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      wakeUp.wait(lock, [&] { return stopping || batch != lastBatch; });
+      if (stopping)
+        return;
+      lastBatch = batch;
+      if (numJoined == numWorkers)
+        continue;
+      ++numJoined;
+      lock.unlock();
+      for (int i = nextJob++; i < numJobsTotal; i = nextJob++)
+        (*job)(i);
+      lock.lock();
+      if (++numFinished == numWorkers)
+        done.notify_one();
+    }
+  }
+
+  static thread_local bool workerThread;
+  std::mutex runMutex;
+  std::mutex mutex;
+  std::condition_variable wakeUp;
+  std::condition_variable done;
+  vector<thread> threads;
+  const function<void(int)>* job = nullptr;
+  int numJobsTotal = 0;
+  std::atomic<int> nextJob {0};
+  int numWorkers = 0;
+  int numJoined = 0;
+  int numFinished = 0;
+  int batch = 0;
+  bool stopping = false;
+};
+
+thread_local bool WorkerPool::workerThread = false;
+}
+
+void runParallel(int numJobs, function<void(int)> fun, int maxThreads) {
+  int numThreads = maxThreads > 0 ? maxThreads : max<int>(1, thread::hardware_concurrency());
+  numThreads = min(numThreads, numJobs);
+  // Nested calls and calls made while another thread uses the pool run on the calling thread. Its Random
+  // is restored afterwards, so that the caller's sequence doesn't depend on where the jobs ran.
+  if (numThreads <= 1 || WorkerPool::isWorkerThread() || !WorkerPool::get().tryRun(numJobs, fun, numThreads)) {
+    auto randomState = Random.getState();
+    OnExit restore([&] { Random.setState(randomState); });
+    for (int i = 0; i < numJobs; ++i)
+      fun(i);
+  }
+}
+
 //#endif
 
 ConstructorFunction::ConstructorFunction(function<void()> fun) {
@@ -704,6 +704,15 @@ class RandomGen {
   RandomGen();
   RandomGen(RandomGen&) = delete;
   void init(int seed);
+  // Seed for the generator of a new thread. It depends only on this generator's seed and on how many
+  // children were seeded before, so it doesn't advance the sequence.
+  int getChildSeed();
+  struct State {
+    std::mt19937 generator;
+    std::uniform_real_distribution<double> defaultDist;
+  };
+  State getState() const;
+  void setState(const State&);
   int get(int max);
   long long getLL();
   int get(int min, int max);
@@ -873,6 +882,8 @@ class RandomGen {
   private:
   std::mt19937 generator;
   std::uniform_real_distribution<double> defaultDist;
+  unsigned long long seed = std::mt19937::default_seed;
+  unsigned long long numChildren = 0;
 
   template <typename T>
   T&& chooseImpl(T&& cur, int total) {
@@ -885,7 +896,8 @@ class RandomGen {
   }
 };
 
-extern RandomGen Random;
+// Each thread has its own generator, so games can be simulated in parallel.
+extern thread_local RandomGen Random;
 
 inline std::ostream& operator <<(std::ostream& d, Rectangle rect) {
   return d << "(" << rect.left() << "," << rect.top() << ") (" << rect.right() << "," << rect.bottom() << ")";
@@ -1778,6 +1790,10 @@ class scoped_thread {
 
 scoped_thread makeScopedThread(function<void()> fun);
 
+// Calls fun for every index in [0, numJobs) on a pool of persistent worker threads and waits until all are done.
+// The jobs run on the calling thread instead if it's a pool thread itself or the pool is busy.
+void runParallel(int numJobs, function<void(int)> fun, int maxThreads = 0);
+
 void openUrl(const string& url);
 
 template <typename T, typename... Args>